@@ -0,0 +1,70 @@
+//
+//  allocations.cpp
+//  bench
+//
+
+#include "allocations.h"
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+static std::atomic<size_t> allocations(0), bytes(0);
+
+size_t bench::allocationCount() { return allocations; }
+size_t bench::allocatedBytes() { return bytes; }
+
+static void *countedAlloc(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  bytes.fetch_add(size, std::memory_order_relaxed);
+  return malloc(size ? size : 1);
+}
+
+// Every form of new and delete is replaced, so they all pair up through malloc and free. They live in a
+// file of their own, which keeps the compiler from inlining them into callers and then warning about
+// free() on memory from new.
+
+void *operator new(size_t size) {
+  void *p = countedAlloc(size);
+  if(!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return countedAlloc(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return countedAlloc(size); }
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+#ifdef __cpp_aligned_new
+static void *countedAlloc(size_t size, std::align_val_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  bytes.fetch_add(size, std::memory_order_relaxed);
+  
+  void *p = NULL;
+  size_t align = (size_t)alignment < sizeof(void *) ? sizeof(void *) : (size_t)alignment;
+  return posix_memalign(&p, align, size ? size : 1) ? NULL : p;
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  void *p = countedAlloc(size, alignment);
+  if(!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return countedAlloc(size, alignment); }
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return countedAlloc(size, alignment); }
+
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
+#endif
@@ -0,0 +1,20 @@
+//
+//  allocations.h
+//  bench
+//
+
+#ifndef __bench__allocations__
+#define __bench__allocations__
+
+#include <stddef.h>
+
+// The benchmark replaces the global operator new and delete to count allocations.
+// Only allocations through operator new are counted, that is tags, names, vectors and strings.
+// Array payloads and zlib's buffers come from malloc and show up in the peak RSS only.
+
+namespace bench {
+  size_t allocationCount(); //!< Allocations through operator new since the start of the program
+  size_t allocatedBytes();  //!< Bytes requested by them
+}
+
+#endif /* defined(__bench__allocations__) */
@@ -0,0 +1,234 @@
+//
+//  bench.cpp
+//  bench
+//
+
+#include "corpus.h"
+#include "allocations.h"
+
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+
+using namespace nbt;
+using namespace bench;
+
+// Usage: bench [-t seconds] [-s scale] [-c corpus] [-o operation] [files...]
+//
+// Runs every operation on every sample of the synthetic corpus (and on the given files) for at least
+// the given time per measurement and reports the best run. MB/s always refers to the uncompressed
+// size, so the numbers of different operations on the same sample can be compared directly.
+
+#pragma mark - Measuring
+
+namespace {
+  struct Options {
+    double seconds = 0.5;
+    double scale = 1;
+    const char *corpus = NULL;    //!< Only samples whose name contains this
+    const char *operation = NULL; //!< Only operations whose name contains this
+  };
+  
+  typedef std::chrono::steady_clock Clock;
+  
+  //! Time and allocations between construction and stop()
+  class Stopwatch {
+  public:
+    struct Span {
+      double seconds;
+      size_t allocations, bytes;
+    };
+    
+    Stopwatch() : allocations(allocationCount()), bytes(allocatedBytes()), start(Clock::now()) {}
+    
+    Span stop() const {
+      Span span;
+      span.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      span.allocations = allocationCount() - allocations;
+      span.bytes = allocatedBytes() - bytes;
+      return span;
+    }
+    
+  private:
+    size_t allocations, bytes;
+    Clock::time_point start;
+  };
+  
+  struct Result {
+    double best; //!< Seconds
+    size_t runs;
+    size_t allocations, bytes; //!< Per run
+  };
+  
+  //! Calls run until at least minSeconds have passed (and at least three times) and keeps the fastest.
+  //! Runs stop their stopwatch themselves, so setup and teardown (like deleting the tree that was
+  //! just read) are left out.
+  Result measure(const std::function<Stopwatch::Span ()> &run, double minSeconds) {
+    Stopwatch::Span first = run(); // Also warms up caches and the allocator
+    
+    Result result;
+    result.best = first.seconds;
+    result.allocations = first.allocations;
+    result.bytes = first.bytes;
+    result.runs = 1;
+    
+    for(double total = first.seconds; total < minSeconds || result.runs < 3; ++result.runs) {
+      double t = run().seconds;
+      if(t < result.best) result.best = t;
+      total += t;
+    }
+    return result;
+  }
+  
+  struct Operation {
+    const char *name;
+    bool countsTags; //!< Whether tags/s means something for this operation
+    std::function<Stopwatch::Span (const Sample &)> run;
+  };
+  
+  std::vector<Operation> operations() {
+    std::vector<Operation> ops;
+    
+    ops.push_back({ "read", true, [](const Sample &sample) {
+      Stopwatch watch;
+      Tag *tag = Tag::read((const uint8_t *)sample.raw.data(), sample.raw.length());
+      Stopwatch::Span span = watch.stop();
+      delete tag;
+      return span;
+    }});
+    
+    ops.push_back({ "read-lazy", true, [](const Sample &sample) {
+      Stopwatch watch;
+      ByteReader reader((const uint8_t *)sample.raw.data(), sample.raw.length());
+      reader.lazyArrays = true;
+      Tag *tag = Tag::read(reader);
+      Stopwatch::Span span = watch.stop();
+      delete tag;
+      return span;
+    }});
+    
+    ops.push_back({ "read-arena", true, [](const Sample &sample) {
+      std::unique_ptr<Document> document(new Document());
+      Stopwatch watch;
+      document->parse((const uint8_t *)sample.raw.data(), sample.raw.length());
+      return watch.stop();
+    }});
+    
+    ops.push_back({ "write", true, [](const Sample &sample) {
+      Tag *tag = Tag::read((const uint8_t *)sample.raw.data(), sample.raw.length());
+      
+      // A writer without a previous encoding, so every tag is encoded instead of copied
+      Stopwatch watch;
+      std::basic_string<unsigned char> output(Tag::encodedSize(tag, true), 0);
+      ByteWriter writer(&output[0], output.length());
+      Tag::write(tag, writer, tag->name.str());
+      Stopwatch::Span span = watch.stop();
+      
+      if(output.length() != sample.raw.length()) throw "Written document differs in size.";
+      delete tag;
+      return span;
+    }});
+    
+    ops.push_back({ "inflate", false, [](const Sample &sample) {
+      Stopwatch watch;
+      std::string raw = zlibInflate(sample.compressed);
+      Stopwatch::Span span = watch.stop();
+      
+      if(raw.length() != sample.raw.length()) throw "Inflated document differs in size.";
+      return span;
+    }});
+    
+    ops.push_back({ "deflate", false, [](const Sample &sample) {
+      Stopwatch watch;
+      zlibDeflate(sample.raw);
+      return watch.stop();
+    }});
+    
+    ops.push_back({ "round-trip", true, [](const Sample &sample) {
+      Stopwatch watch;
+      DataFormat format;
+      Tag *tag = Tag::load(sample.compressed, &format);
+      Tag::save(tag, format.compression);
+      delete tag;
+      return watch.stop();
+    }});
+    
+    return ops;
+  }
+  
+  size_t peakRSS() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss; // Bytes
+#else
+    return usage.ru_maxrss * 1024; // Kilobytes
+#endif
+  }
+  
+  bool parseOptions(int argc, const char *argv[], Options &options, std::vector<std::string> &files) {
+    for(int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      
+      if(!strcmp(arg, "-t") && hasValue) options.seconds = atof(argv[++i]);
+      else if(!strcmp(arg, "-s") && hasValue) options.scale = atof(argv[++i]);
+      else if(!strcmp(arg, "-c") && hasValue) options.corpus = argv[++i];
+      else if(!strcmp(arg, "-o") && hasValue) options.operation = argv[++i];
+      else if(arg[0] == '-') return false;
+      else files.push_back(arg);
+    }
+    return options.scale > 0;
+  }
+}
+
+int main(int argc, const char *argv[]) {
+  Options options;
+  std::vector<std::string> files;
+  if(!parseOptions(argc, argv, options, files)) {
+    fprintf(stderr, "usage: %s [-t seconds] [-s scale] [-c corpus] [-o operation] [files...]\n", argv[0]);
+    return 1;
+  }
+  
+  std::vector<Sample> corpus;
+  try {
+    corpus = makeCorpus(1, options.scale);
+    for(auto it = files.begin(); it != files.end(); ++it) corpus.push_back(loadSample(*it));
+  } catch(const char *error) {
+    fprintf(stderr, "%s\n", error);
+    return 1;
+  }
+  
+  printf("%-16s %10s %10s %8s\n", "sample", "raw KB", "gzip KB", "tags");
+  for(auto it = corpus.begin(); it != corpus.end(); ++it)
+    printf("%-16s %10.1f %10.1f %8zu\n", it->name.c_str(), it->raw.length() / 1024.0, it->compressed.length() / 1024.0, it->tags);
+  printf("\n%-16s %-11s %10s %12s %12s %12s %6s\n", "sample", "operation", "MB/s", "Mtags/s", "allocs/run", "KB new/run", "runs");
+  
+  std::vector<Operation> ops = operations();
+  for(auto sample = corpus.begin(); sample != corpus.end(); ++sample) {
+    if(options.corpus && !strstr(sample->name.c_str(), options.corpus)) continue;
+    
+    for(auto op = ops.begin(); op != ops.end(); ++op) {
+      if(options.operation && !strstr(op->name, options.operation)) continue;
+      
+      Result result;
+      try {
+        result = measure(std::bind(op->run, std::cref(*sample)), options.seconds);
+      } catch(const char *error) {
+        printf("%-16s %-11s failed: %s\n", sample->name.c_str(), op->name, error);
+        continue;
+      }
+      
+      printf("%-16s %-11s %10.1f ", sample->name.c_str(), op->name, sample->raw.length() / result.best / 1e6);
+      if(op->countsTags) printf("%12.2f ", sample->tags / result.best / 1e6);
+      else printf("%12s ", "-");
+      printf("%12zu %12.1f %6zu\n", result.allocations, result.bytes / 1024.0, result.runs);
+    }
+  }
+  
+  printf("\npeak RSS %.1f MB\n", peakRSS() / 1048576.0);
+  return 0;
+}
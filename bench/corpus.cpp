@@ -0,0 +1,266 @@
+//
+//  corpus.cpp
+//  bench
+//
+
+#include "corpus.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace nbt;
+using namespace bench;
+
+#pragma mark - Building trees
+
+namespace {
+  //! xorshift64*, so the corpus doesn't depend on the standard library's generators
+  class Random {
+  public:
+    explicit Random(uint64_t seed) : state(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+    
+    uint64_t next() {
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      return state * 0x2545f4914f6cdd1dull;
+    }
+    
+    uint32_t below(uint32_t n) { return (uint32_t)(next() % n); }
+    double real() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    
+    std::string word(size_t minLength, size_t maxLength) {
+      static const char letters[] = "abcdefghijklmnopqrstuvwxyz_";
+      std::string s(minLength + below((uint32_t)(maxLength - minLength + 1)), 0);
+      for(size_t i = 0; i < s.length(); ++i) s[i] = letters[below(sizeof(letters) - 1)];
+      return s;
+    }
+    
+  private:
+    uint64_t state;
+  };
+  
+  size_t scaled(size_t n, double scale) {
+    size_t s = (size_t)(n * scale);
+    return s ? s : 1;
+  }
+  
+  template<typename T> T *add(CompoundTag *compound, const char *key, T *tag) {
+    tag->name = key;
+    tag->hasName = true;
+    compound->value.append(tag->name, std::shared_ptr<Tag>(tag));
+    return tag;
+  }
+  
+  template<typename T> T *add(ListTag *list, T *tag) {
+    tag->parent = list;
+    list->value.push_back(std::shared_ptr<Tag>(tag));
+    return tag;
+  }
+  
+  ListTag *makeList(TagType::Enum entryKind) {
+    ListTag *list = new ListTag();
+    list->entryKind = entryKind;
+    return list;
+  }
+  
+  template<typename ArrayTag, typename Fill> ArrayTag *makeArray(size_t count, Fill fill) {
+    ArrayTag *tag = new ArrayTag();
+    tag->value.allocate(count);
+    for(size_t i = 0; i < count; ++i) tag->value.data.get()[i] = fill(i);
+    return tag;
+  }
+  
+#pragma mark - Shapes
+  
+  void addBranch(CompoundTag *parent, const char *key, Random &random, unsigned depth) {
+    CompoundTag *node = add(parent, key, new CompoundTag());
+    add(node, "id", new IntTag((int32_t)random.next()));
+    add(node, "weight", new DoubleTag(random.real()));
+    add(node, "label", new StringTag(random.word(3, 12)));
+    add(node, "flag", new ByteTag((int8_t)random.below(2)));
+    
+    static const char *keys[] = { "a", "b", "c", "d" };
+    if(depth > 0)
+      for(unsigned i = 0; i < 4; ++i) addBranch(node, keys[i], random, depth - 1);
+  }
+  
+  CompoundTag *deepCompounds(Random &random, double scale) {
+    CompoundTag *root = new CompoundTag();
+    
+    CompoundTag *chain = root;
+    for(unsigned i = 0; i < 512; ++i) {
+      chain = add(chain, "nested", new CompoundTag());
+      add(chain, "level", new IntTag(i));
+    }
+    
+    CompoundTag *forest = add(root, "forest", new CompoundTag());
+    for(size_t i = 0, n = scaled(4, scale); i < n; ++i) addBranch(forest, ("tree" + std::to_string(i)).c_str(), random, 6);
+    return root;
+  }
+  
+  CompoundTag *hugeLists(Random &random, double scale) {
+    CompoundTag *root = new CompoundTag();
+    
+    ListTag *ints = add(root, "ints", makeList(TagType::Int));
+    for(size_t i = 0, n = scaled(200000, scale); i < n; ++i) add(ints, new IntTag((int32_t)random.next()));
+    
+    ListTag *doubles = add(root, "doubles", makeList(TagType::Double));
+    for(size_t i = 0, n = scaled(100000, scale); i < n; ++i) add(doubles, new DoubleTag(random.real() * 1000));
+    
+    ListTag *points = add(root, "points", makeList(TagType::Compound));
+    for(size_t i = 0, n = scaled(30000, scale); i < n; ++i) {
+      CompoundTag *point = add(points, new CompoundTag());
+      add(point, "x", new IntTag(random.below(1 << 20)));
+      add(point, "y", new IntTag(random.below(256)));
+      add(point, "z", new IntTag(random.below(1 << 20)));
+    }
+    
+    ListTag *motions = add(root, "motions", makeList(TagType::List));
+    for(size_t i = 0, n = scaled(20000, scale); i < n; ++i) {
+      ListTag *motion = add(motions, makeList(TagType::Float));
+      for(unsigned j = 0; j < 3; ++j) add(motion, new FloatTag((float)random.real()));
+    }
+    return root;
+  }
+  
+  CompoundTag *bigArrays(Random &random, double scale) {
+    CompoundTag *root = new CompoundTag();
+    add(root, "bytes", makeArray<ByteArrayTag>(scaled(4 << 20, scale), [&](size_t) { return (uint8_t)random.next(); }));
+    add(root, "ints", makeArray<IntArrayTag>(scaled(1 << 20, scale), [&](size_t) { return (int32_t)random.next(); }));
+    add(root, "longs", makeArray<LongArrayTag>(scaled(512 << 10, scale), [&](size_t) { return (int64_t)random.next(); }));
+    
+    // Heightmap-like: small, slowly changing values, which compress well
+    add(root, "heights", makeArray<IntArrayTag>(scaled(1 << 20, scale), [&](size_t i) { return (int32_t)(64 + (i / 64) % 32); }));
+    return root;
+  }
+  
+  CompoundTag *shortStrings(Random &random, double scale) {
+    CompoundTag *root = new CompoundTag();
+    
+    CompoundTag *names = add(root, "names", new CompoundTag());
+    for(size_t i = 0, n = scaled(50000, scale); i < n; ++i)
+      add(names, ("k" + std::to_string(i)).c_str(), new StringTag(random.word(1, 16)));
+      
+    ListTag *words = add(root, "words", makeList(TagType::String));
+    for(size_t i = 0, n = scaled(100000, scale); i < n; ++i) add(words, new StringTag(random.word(0, 8)));
+    return root;
+  }
+  
+  CompoundTag *chunk(Random &random, int x, int z) {
+    static const char *blocks[] = {
+      "minecraft:stone", "minecraft:dirt", "minecraft:grass_block", "minecraft:deepslate", "minecraft:water",
+      "minecraft:air", "minecraft:coal_ore", "minecraft:iron_ore", "minecraft:gravel", "minecraft:andesite"
+    };
+    
+    CompoundTag *root = new CompoundTag();
+    add(root, "DataVersion", new IntTag(3465));
+    add(root, "xPos", new IntTag(x));
+    add(root, "zPos", new IntTag(z));
+    add(root, "Status", new StringTag("minecraft:full"));
+    add(root, "LastUpdate", new LongTag((int64_t)random.below(1 << 30)));
+    
+    ListTag *sections = add(root, "sections", makeList(TagType::Compound));
+    for(int y = -4; y < 20; ++y) {
+      CompoundTag *section = add(sections, new CompoundTag());
+      add(section, "Y", new ByteTag((int8_t)y));
+      
+      CompoundTag *states = add(section, "block_states", new CompoundTag());
+      ListTag *palette = add(states, "palette", makeList(TagType::Compound));
+      unsigned paletteSize = 1 + random.below(10);
+      for(unsigned i = 0; i < paletteSize; ++i) {
+        CompoundTag *entry = add(palette, new CompoundTag());
+        add(entry, "Name", new StringTag(blocks[i]));
+        if(random.below(3) == 0) add(add(entry, "Properties", new CompoundTag()), "axis", new StringTag("y"));
+      }
+      if(paletteSize > 1) add(states, "data", makeArray<LongArrayTag>(256, [&](size_t) { return (int64_t)random.next(); }));
+      
+      add(section, "BlockLight", makeArray<ByteArrayTag>(2048, [&](size_t) { return (uint8_t)random.below(16); }));
+      add(section, "SkyLight", makeArray<ByteArrayTag>(2048, [](size_t) { return (uint8_t)0xff; }));
+    }
+    
+    CompoundTag *heightmaps = add(root, "Heightmaps", new CompoundTag());
+    add(heightmaps, "MOTION_BLOCKING", makeArray<LongArrayTag>(37, [&](size_t) { return (int64_t)random.next(); }));
+    add(heightmaps, "WORLD_SURFACE", makeArray<LongArrayTag>(37, [&](size_t) { return (int64_t)random.next(); }));
+    
+    ListTag *entities = add(root, "block_entities", makeList(TagType::Compound));
+    for(unsigned i = 0, n = random.below(6); i < n; ++i) {
+      CompoundTag *entity = add(entities, new CompoundTag());
+      add(entity, "id", new StringTag("minecraft:chest"));
+      add(entity, "x", new IntTag(x * 16 + (int)random.below(16)));
+      add(entity, "y", new IntTag((int)random.below(320) - 64));
+      add(entity, "z", new IntTag(z * 16 + (int)random.below(16)));
+      
+      ListTag *items = add(entity, "Items", makeList(TagType::Compound));
+      for(unsigned j = 0, m = random.below(27); j < m; ++j) {
+        CompoundTag *item = add(items, new CompoundTag());
+        add(item, "Slot", new ByteTag((int8_t)j));
+        add(item, "id", new StringTag(blocks[random.below(10)]));
+        add(item, "Count", new ByteTag((int8_t)(1 + random.below(64))));
+      }
+    }
+    return root;
+  }
+  
+  CompoundTag *chunks(Random &random, double scale) {
+    CompoundTag *root = new CompoundTag();
+    ListTag *list = add(root, "chunks", makeList(TagType::Compound));
+    for(size_t i = 0, n = scaled(64, scale); i < n; ++i) add(list, chunk(random, (int)(i % 32), (int)(i / 32)));
+    return root;
+  }
+  
+  //! Takes ownership of root, which is written as a named tag like in files from the game
+  Sample makeSample(const std::string &name, Tag *root) {
+    root->hasName = true;
+    
+    Sample sample;
+    sample.name = name;
+    sample.tags = countTags(root);
+    
+    auto raw = Tag::serialize(root);
+    sample.raw.assign((const char *)raw.data(), raw.size());
+    sample.compressed = zlibDeflate(sample.raw);
+    
+    delete root;
+    return sample;
+  }
+}
+
+#pragma mark - Interface
+
+std::vector<Sample> bench::makeCorpus(uint64_t seed, double scale) {
+  Random random(seed);
+  
+  std::vector<Sample> corpus;
+  corpus.push_back(makeSample("deep-compounds", deepCompounds(random, scale)));
+  corpus.push_back(makeSample("huge-lists", hugeLists(random, scale)));
+  corpus.push_back(makeSample("big-arrays", bigArrays(random, scale)));
+  corpus.push_back(makeSample("short-strings", shortStrings(random, scale)));
+  corpus.push_back(makeSample("chunks", chunks(random, scale)));
+  return corpus;
+}
+
+Sample bench::loadSample(const std::string &path) {
+  std::ifstream is(path.c_str(), std::ios::binary);
+  if(!is) throw "Could not open the file.";
+  
+  std::stringstream buffer;
+  buffer << is.rdbuf();
+  
+  Tag *root = Tag::load(buffer.str());
+  
+  size_t slash = path.find_last_of("/\\");
+  return makeSample(slash == std::string::npos ? path : path.substr(slash + 1), root);
+}
+
+size_t bench::countTags(const Tag *tag) {
+  size_t count = 1;
+  if(tag->tagType() == TagType::Compound) {
+    const TagHash &hash = ((const CompoundTag *)tag)->value;
+    for(auto it = hash.begin(); it != hash.end(); ++it) count += countTags(it->second.get());
+  } else if(tag->tagType() == TagType::List) {
+    const std::vector<std::shared_ptr<Tag>> &list = ((const ListTag *)tag)->value;
+    for(auto it = list.begin(); it != list.end(); ++it) count += countTags(it->get());
+  }
+  return count;
+}
@@ -0,0 +1,39 @@
+//
+//  corpus.h
+//  bench
+//
+
+#ifndef __bench__corpus__
+#define __bench__corpus__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "nbt_utils.h"
+
+namespace bench {
+  //! One input of the benchmark: an uncompressed, named NBT document and its gzip form
+  struct Sample {
+    std::string name;
+    std::string raw;
+    std::string compressed;
+    size_t tags; //!< Number of tags in the document, including the root
+  };
+  
+  //! Synthetic documents, each stressing one shape of data:
+  //!   deep-compounds  compounds nested up to 512 levels and a wide tree of small compounds
+  //!   huge-lists      long lists of numbers, of small compounds and of short lists
+  //!   big-arrays      multi-megabyte byte, int and long arrays
+  //!   short-strings   many small string entries and a long list of strings
+  //!   chunks          a region's worth of chunk-like trees (sections, palettes, block states, entities)
+  //! The content only depends on seed and scale, so runs on different machines see the same bytes.
+  std::vector<Sample> makeCorpus(uint64_t seed = 1, double scale = 1);
+  
+  //! A sample from a file on disk (gzip, zlib or uncompressed), throws if it isn't valid NBT
+  Sample loadSample(const std::string &path);
+  
+  size_t countTags(const nbt::Tag *tag);
+}
+
+#endif /* defined(__bench__corpus__) */
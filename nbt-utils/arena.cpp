@@ -0,0 +1,42 @@
+//
+//  arena.cpp
+//  nbt-utils
+//
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+using namespace nbt;
+
+Arena::~Arena() {
+  for(auto it = blocks.begin(); it != blocks.end(); ++it) free(*it);
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+  char *p = (char *)(((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1));
+  if(cursor && p + size <= end) {
+    cursor = p + size;
+    used += size;
+    return p;
+  }
+  
+  // Big allocations get a block of their own so they don't waste the rest of the current one.
+  bool dedicated = size + alignment > blockSize / 4;
+  size_t length = dedicated ? size + alignment : blockSize;
+  
+  char *block = (char *)malloc(length);
+  if(!block) throw std::bad_alloc();
+  blocks.push_back(block);
+  
+  p = (char *)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+  if(!dedicated) {
+    cursor = p + size;
+    end = block + length;
+  }
+  
+  used += size;
+  return p;
+}
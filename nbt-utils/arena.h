@@ -0,0 +1,71 @@
+//
+//  arena.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__arena__
+#define __nbt_utils__arena__
+
+#include <stddef.h>
+#include <vector>
+
+namespace nbt {
+  //! Monotonic allocator: allocations are carved out of large blocks and only released all at once
+  //! when the arena is destroyed. Not thread-safe.
+  //!
+  //! A Document (nbt_utils.h) takes these from its arena while parsing:
+  //!  - every tag, together with the control block of its shared_ptr (makeSharedTag)
+  //!  - byte, int and long array payloads (Array::allocate), unless they borrow the input (ByteReader::lazyArrays)
+  //! These stay on the heap, as the containers use the standard allocator:
+  //!  - the Entry vector of every TagHash, and its slot index once it has one
+  //!  - the element vector (std::vector<std::shared_ptr<Tag>>) of every ListTag
+  //!  - StringTag values, where longer than the std::string's inline buffer
+  //!  - tag names and compound keys, which are entries in the process-wide Name pool shared by all documents
+  //!  - array payloads replaced after parsing: resizes, and the private copy mutate() or ownData() makes of
+  //!    a shared or borrowed payload
+  class Arena {
+  public:
+    explicit Arena(size_t blockSize = 64 << 10) : blockSize(blockSize), cursor(NULL), end(NULL), used(0) {}
+    ~Arena();
+    
+    void *allocate(size_t size, size_t alignment = sizeof(void *) * 2);
+    
+    size_t bytesAllocated() const { return used; }
+    size_t blockCount() const { return blocks.size(); }
+    
+  private:
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+    
+    size_t blockSize;
+    char *cursor, *end;
+    size_t used;
+    std::vector<void *> blocks;
+  };
+  
+  //! Standard allocator interface on top of an Arena, deallocation is a no-op
+  template<typename T>
+  struct ArenaAllocator {
+    typedef T value_type;
+    
+    Arena *arena;
+    
+    ArenaAllocator(Arena *arena) : arena(arena) {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+    
+    T *allocate(size_t n) { return (T *)arena->allocate(n * sizeof(T), alignof(T) > sizeof(void *) * 2 ? alignof(T) : sizeof(void *) * 2); }
+    void deallocate(T *, size_t) {}
+    
+    template<typename U> struct rebind { typedef ArenaAllocator<U> other; };
+    
+    template<typename U> bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template<typename U> bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+  };
+  
+  //! Deleter for memory owned by an Arena
+  struct ArenaDeleter {
+    template<typename T> void operator()(T *) const {}
+  };
+}
+
+#endif /* defined(__nbt_utils__arena__) */
@@ -0,0 +1,134 @@
+//
+//  batch_decoder.cpp
+//  nbt-utils
+//
+
+#include "batch_decoder.h"
+
+#include <zlib.h>
+#include <new>
+#include <exception>
+
+using namespace nbt;
+
+struct BatchDecoder::Scratch {
+  z_stream strm;
+  std::vector<uint8_t> buffer; //!< Decompressed document, only ever grows
+  
+  Scratch() : buffer(256 << 10) {
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in = 0;
+    strm.next_in = Z_NULL;
+    
+    // +32 lets zlib detect gzip and zlib headers by itself.
+    if(inflateInit2(&strm, MAX_WBITS | 32) != Z_OK) throw "zlib inflateInit failed.";
+  }
+  
+  ~Scratch() { inflateEnd(&strm); }
+  
+  //! Decompresses into buffer, returns the decompressed size
+  size_t inflate(const uint8_t *data, size_t size) {
+    inflateReset(&strm);
+    strm.next_in = const_cast<uint8_t *>(data); // zlib does not write to the input
+    strm.avail_in = (uInt)size;
+    
+    size_t have = 0;
+    for(;;) {
+      if(have == buffer.size()) buffer.resize(buffer.size() * 2);
+      
+      strm.next_out = buffer.data() + have;
+      strm.avail_out = (uInt)(buffer.size() - have);
+      
+      int zret = ::inflate(&strm, Z_NO_FLUSH);
+      have = buffer.size() - strm.avail_out;
+      
+      switch(zret) {
+        case Z_STREAM_END: return have;
+        case Z_OK: break;
+        case Z_BUF_ERROR:
+          if(strm.avail_in == 0) throw "Unexpected end of compressed data.";
+          break; // Output buffer full, grow it
+        default: throw "zlib inflate error.";
+      }
+    }
+  }
+};
+
+BatchDecoder::BatchDecoder(unsigned threadCount) : pool(threadCount) {
+  for(unsigned i = 0; i < pool.getThreadCount(); ++i)
+    scratch.push_back(std::unique_ptr<Scratch>(new Scratch()));
+}
+
+BatchDecoder::~BatchDecoder() {}
+
+Tag *BatchDecoder::decodeBlob(const Blob &blob, bool withName, Scratch &scratch) {
+  if(detectCompression(blob.data, blob.size) == Compression::None)
+    return Tag::read(blob.data, blob.size, withName);
+  
+  size_t size = scratch.inflate(blob.data, blob.size);
+  return Tag::read(scratch.buffer.data(), size, withName);
+}
+
+std::vector<DecodeResult> BatchDecoder::decode(const std::vector<Blob> &blobs, bool withName) {
+  std::vector<DecodeResult> results(blobs.size());
+  
+  pool.run(blobs.size(), [&](size_t index, unsigned worker) {
+    DecodeResult &result = results[index];
+    result.error = NULL;
+    
+    try {
+      result.tag.reset(decodeBlob(blobs[index], withName, *scratch[worker]));
+    } catch(const char *error) {
+      result.error = error;
+    } catch(const std::bad_alloc &) {
+      // what() can't be kept beyond the handler, so exceptions from the standard library get a fixed message.
+      result.error = "Not enough memory to decode the document.";
+    } catch(const std::exception &) {
+      result.error = "Decoding the document failed.";
+    }
+  });
+  
+  return results;
+}
+
+std::vector<DecodeResult> BatchDecoder::decode(const std::vector<std::string> &blobs, bool withName) {
+  std::vector<Blob> views(blobs.size());
+  for(size_t i = 0; i < blobs.size(); ++i) {
+    views[i].data = (const uint8_t *)blobs[i].data();
+    views[i].size = blobs[i].length();
+  }
+  
+  return decode(views, withName);
+}
+
+std::vector<DecodeResult> BatchDecoder::decode(const RegionFile &region, std::vector<ChunkPos> *positions) {
+  std::vector<DecodeResult> results;
+  std::vector<Blob> blobs;
+  std::vector<size_t> slots; // Result index of each blob, chunks with a broken header only get their error
+  if(positions) positions->clear();
+  
+  for(RegionFile::iterator it = region.begin(); it != region.end(); ++it) {
+    DecodeResult result = { nullptr, NULL };
+    
+    try {
+      Blob blob;
+      Compression::Enum compression;
+      region.getChunkData(it->x, it->z, blob.data, blob.size, compression);
+      
+      blobs.push_back(blob);
+      slots.push_back(results.size());
+    } catch(const char *error) {
+      result.error = error;
+    }
+    
+    results.push_back(result);
+    if(positions) positions->push_back(*it);
+  }
+  
+  std::vector<DecodeResult> decoded = decode(blobs, true);
+  for(size_t i = 0; i < decoded.size(); ++i) results[slots[i]] = decoded[i];
+  
+  return results;
+}
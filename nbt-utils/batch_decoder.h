@@ -0,0 +1,60 @@
+//
+//  batch_decoder.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__batch_decoder__
+#define __nbt_utils__batch_decoder__
+
+#include <memory>
+
+#include "nbt_utils.h"
+#include "region_file.h"
+#include "thread_pool.h"
+
+namespace nbt {
+  //! A compressed (or uncompressed) NBT document in memory, borrowed for the duration of a decode
+  struct Blob {
+    const uint8_t *data;
+    size_t size;
+  };
+  
+  struct DecodeResult {
+    std::shared_ptr<Tag> tag; //!< NULL if the blob could not be decoded
+    const char *error;        //!< Why decoding failed, NULL on success
+  };
+  
+  //! Decompresses and parses many independent documents (region chunks, player .dat files, ...)
+  //! on a thread pool. Every worker keeps its own inflate state and output buffer across documents,
+  //! so a batch doesn't pay for zlib setup and buffer growth once per document.
+  //! One BatchDecoder must not be used by several threads at the same time.
+  class BatchDecoder {
+  public:
+    //! @param threadCount Number of threads to decode on, 0 for one per hardware thread
+    explicit BatchDecoder(unsigned threadCount = 0);
+    ~BatchDecoder();
+    
+    //! Results are in the order of the input. Gzip, zlib and uncompressed blobs can be mixed,
+    //! a blob that fails to decode is reported in its result instead of aborting the batch.
+    std::vector<DecodeResult> decode(const std::vector<Blob> &blobs, bool withName = true);
+    std::vector<DecodeResult> decode(const std::vector<std::string> &blobs, bool withName = true);
+    
+    //! Decodes every chunk that is present in the region
+    //! @param positions Receives the position of each result's chunk
+    std::vector<DecodeResult> decode(const RegionFile &region, std::vector<ChunkPos> *positions = NULL);
+    
+    unsigned getThreadCount() const { return pool.getThreadCount(); }
+    
+  private:
+    BatchDecoder(const BatchDecoder &);
+    BatchDecoder &operator=(const BatchDecoder &);
+    
+    struct Scratch;
+    Tag *decodeBlob(const Blob &blob, bool withName, Scratch &scratch);
+    
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Scratch>> scratch; //!< One per worker
+  };
+}
+
+#endif /* defined(__nbt_utils__batch_decoder__) */
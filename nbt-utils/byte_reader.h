@@ -0,0 +1,101 @@
+//
+//  byte_reader.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__byte_reader__
+#define __nbt_utils__byte_reader__
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <memory>
+
+#include "endianness.h"
+
+namespace nbt {
+  class Arena;
+  
+  //! Bounds-checked big-endian cursor over a borrowed, contiguous byte buffer.
+  //! The buffer has to outlive the reader; nothing is copied.
+  //! Subclasses can produce the data incrementally by overriding fill(), in which case pointers
+  //! returned by take() are only valid until the next read.
+  class ByteReader {
+  public:
+    //! @param base Logical offset of data[0], used for startIndex/endIndex bookkeeping
+    ByteReader(const uint8_t *data, size_t size, size_t base = 0)
+      : arena(NULL), lazyArrays(false), begin(data), cursor(data), end(data + size), base(base) {}
+    virtual ~ByteReader() {}
+    
+    Arena *arena; //!< Where tags read through this reader are allocated (NULL for the heap)
+    
+    //! Keep array payloads in big-endian wire order until they are modified (see Array::mutate),
+    //! arrays that are never touched are then written back with a plain copy.
+    bool lazyArrays;
+    
+    //! If set, lazy arrays point straight into the input instead of copying it and hold on to this
+    //! to keep the input alive. Only valid if the input doesn't move, i.e. not for streaming readers.
+    std::shared_ptr<const void> keepalive;
+    
+    size_t tell() const { return base + (cursor - begin); }
+    size_t remaining() const { return end - cursor; } //!< Bytes available without calling fill()
+    bool atEnd() const { return cursor == end; }
+    
+    //! Throws unless at least n more bytes are available
+    void require(size_t n) { if((size_t)(end - cursor) < n) fill(n); }
+    
+    uint8_t peekU8() { require(1); return *cursor; }
+    
+    uint8_t readU8() { require(1); return *cursor++; }
+    
+    uint16_t readU16() {
+      uint16_t v;
+      read(&v, 2);
+      return ntohs(v);
+    }
+    
+    uint32_t readU32() {
+      uint32_t v;
+      read(&v, 4);
+      return ntohl(v);
+    }
+    
+    uint64_t readU64() {
+      uint64_t v;
+      read(&v, 8);
+      return ntohll(v);
+    }
+    
+    void read(void *dst, size_t n) {
+      require(n);
+      memcpy(dst, cursor, n);
+      cursor += n;
+    }
+    
+    //! Returns a pointer to the next n bytes (in wire order) and advances past them
+    const uint8_t *take(size_t n) {
+      require(n);
+      const uint8_t *p = cursor;
+      cursor += n;
+      return p;
+    }
+    
+    void skip(size_t n) {
+      while((size_t)(end - cursor) < n) {
+        n -= end - cursor;
+        cursor = end;
+        fill(1);
+      }
+      cursor += n;
+    }
+    
+  protected:
+    const uint8_t *begin, *cursor, *end;
+    size_t base;
+    
+    //! Called when fewer than n bytes are left, has to make at least n bytes available or throw
+    virtual void fill(size_t n) { throw "Unexpected end of NBT data."; }
+  };
+}
+
+#endif /* defined(__nbt_utils__byte_reader__) */
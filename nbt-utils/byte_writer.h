@@ -0,0 +1,69 @@
+//
+//  byte_writer.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__byte_writer__
+#define __nbt_utils__byte_writer__
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "endianness.h"
+
+namespace nbt {
+  //! Big-endian cursor over a pre-sized output buffer.
+  //! Callers are expected to size the buffer exactly (see Tag::encodedSize), so overflowing it is a bug.
+  class ByteWriter {
+  public:
+    //! @param base Logical offset of data[0], used for startIndex/endIndex bookkeeping
+    ByteWriter(uint8_t *data, size_t size, size_t base = 0)
+      : previous(NULL), previousShift(0), begin(data), cursor(data), end(data + size), base(base) {}
+    
+    const uint8_t *previous; //!< Earlier encoding of the same tree that clean subtrees are copied from (see Tag::serialize)
+    ptrdiff_t previousShift; //!< Shift accumulated by the ancestors of the tag being written, for locating it in previous
+      
+    size_t tell() const { return base + (cursor - begin); }
+    size_t remaining() const { return end - cursor; }
+    
+    void writeU8(uint8_t v) { require(1); *cursor++ = v; }
+    
+    void writeU16(uint16_t v) {
+      v = htons(v);
+      write(&v, 2);
+    }
+    
+    void writeU32(uint32_t v) {
+      v = htonl(v);
+      write(&v, 4);
+    }
+    
+    void writeU64(uint64_t v) {
+      v = htonll(v);
+      write(&v, 8);
+    }
+    
+    void write(const void *src, size_t n) {
+      require(n);
+      memcpy(cursor, src, n);
+      cursor += n;
+    }
+    
+    //! Returns a pointer to the next n bytes for the caller to fill in and advances past them
+    uint8_t *reserve(size_t n) {
+      require(n);
+      uint8_t *p = cursor;
+      cursor += n;
+      return p;
+    }
+    
+  protected:
+    uint8_t *begin, *cursor, *end;
+    size_t base;
+    
+    void require(size_t n) { if((size_t)(end - cursor) < n) throw "NBT output buffer overflow."; }
+  };
+}
+
+#endif /* defined(__nbt_utils__byte_writer__) */
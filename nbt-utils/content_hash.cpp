@@ -0,0 +1,157 @@
+//
+//  content_hash.cpp
+//  nbt-utils
+//
+
+#include "content_hash.h"
+
+using namespace nbt;
+
+#pragma mark - Kernels
+
+static const uint64_t P1 = 0x9e3779b185ebca87ULL, P2 = 0xc2b2ae3d27d4eb4fULL, P3 = 0x165667b19e3779f9ULL,
+                      P4 = 0x85ebca77c2b2ae63ULL, P5 = 0x27d4eb2f165667c5ULL;
+                      
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint64_t accumulate(uint64_t acc, uint64_t lane) { return rotl(acc + lane * P2, 31) * P1; }
+static inline uint64_t combine(uint64_t h, uint64_t lane) { return rotl(h ^ accumulate(0, lane), 27) * P1 + P4; }
+
+static inline uint64_t avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+//! Big-endian, so lanes are the same on every host and match the wire order of arrays
+static inline uint64_t loadLane(const uint8_t *p) {
+  return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 | (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32 |
+         (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 | (uint64_t)p[6] << 8 | (uint64_t)p[7];
+}
+
+//! Four independent accumulators for the bulk of the lanes, the rest is combined one by one.
+//! The caller combines any partial lane and applies avalanche().
+template<typename Lane> static uint64_t hashLanes(size_t count, uint64_t seed, const Lane &lane) {
+  uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+  
+  size_t i = 0;
+  for(; i + 4 <= count; i += 4) {
+    v1 = accumulate(v1, lane(i));
+    v2 = accumulate(v2, lane(i + 1));
+    v3 = accumulate(v3, lane(i + 2));
+    v4 = accumulate(v4, lane(i + 3));
+  }
+  
+  uint64_t h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+  for(; i < count; ++i) h = combine(h, lane(i));
+  return h;
+}
+
+uint64_t nbt::hashBytes(const void *data, size_t size, uint64_t seed) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  size_t lanes = size / 8;
+  
+  uint64_t h = hashLanes(lanes, seed + size, [bytes](size_t i) { return loadLane(bytes + 8 * i); });
+  if(size % 8) {
+    uint64_t tail = 0;
+    for(size_t i = lanes * 8; i < size; ++i) tail = tail << 8 | bytes[i];
+    h = combine(h, tail);
+  }
+  
+  return avalanche(h);
+}
+
+// Arrays in host order produce the same lanes as their wire-order bytes would
+
+static uint64_t hashElements(const int32_t *data, size_t count, uint64_t seed) {
+  uint64_t h = hashLanes(count / 2, seed + count * 4, [data](size_t i) {
+    return (uint64_t)(uint32_t)data[2 * i] << 32 | (uint32_t)data[2 * i + 1];
+  });
+  
+  if(count % 2) h = combine(h, (uint32_t)data[count - 1]);
+  return avalanche(h);
+}
+
+static uint64_t hashElements(const int64_t *data, size_t count, uint64_t seed) {
+  return avalanche(hashLanes(count, seed + count * 8, [data](size_t i) { return (uint64_t)data[i]; }));
+}
+
+static uint64_t hashElements(const uint8_t *data, size_t count, uint64_t seed) { return hashBytes(data, count, seed); }
+
+template<typename T> static uint64_t hashArray(const Array<T> &array, uint64_t seed) {
+  if(array.wireOrder) return hashBytes(array.data.get(), array.count * sizeof(T), seed);
+  return hashElements(array.data.get(), array.count, seed);
+}
+
+#pragma mark - Tags
+
+uint64_t Tag::contentHash() const {
+  if(hashed) return hash;
+  
+  uint64_t seed = P5 + (uint64_t)tagType();
+  uint64_t h = seed;
+  
+  switch(tagType()) {
+#define do_case(type) case TagType::type: h = avalanche(combine(seed, (uint64_t)(int64_t)((const type##Tag *)this)->value)); break;
+      do_case(Byte);
+      do_case(Short);
+      do_case(Int);
+      do_case(Long);
+#undef do_case
+    
+    case TagType::Float: {
+      uint32_t bits;
+      memcpy(&bits, &((const FloatTag *)this)->value, 4);
+      h = avalanche(combine(seed, bits));
+      break;
+    }
+    
+    case TagType::Double: {
+      uint64_t bits;
+      memcpy(&bits, &((const DoubleTag *)this)->value, 8);
+      h = avalanche(combine(seed, bits));
+      break;
+    }
+    
+    case TagType::String: {
+      const std::string &value = ((const StringTag *)this)->value;
+      h = hashBytes(value.data(), value.length(), seed);
+      break;
+    }
+    
+    case TagType::ByteArray: h = hashArray(((const ByteArrayTag *)this)->value, seed); break;
+    case TagType::IntArray: h = hashArray(((const IntArrayTag *)this)->value, seed); break;
+    case TagType::LongArray: h = hashArray(((const LongArrayTag *)this)->value, seed); break;
+    
+    case TagType::List: {
+      const ListTag *list = (const ListTag *)this;
+      h = combine(combine(seed, list->entryKind), list->value.size());
+      for(auto it = list->value.begin(); it != list->value.end(); ++it) h = combine(h, (*it)->contentHash());
+      h = avalanche(h);
+      break;
+    }
+    
+    case TagType::Compound: {
+      // Entries are hashed as key/value pairs and summed, so the order doesn't matter, and entries
+      // shadowed by a later one with the same key are left out, both like equalTags and lookups.
+      const TagHash &entries = ((const CompoundTag *)this)->value;
+      uint64_t sum = 0, count = 0;
+      for(auto it = entries.begin(); it != entries.end(); ++it) {
+        if(entries.find(it->first) != it) continue;
+        
+        sum += avalanche(combine(hashBytes(it->first.data(), it->first.length()), it->second->contentHash()));
+        ++count;
+      }
+      h = avalanche(combine(combine(seed, count), sum));
+      break;
+    }
+    
+    default: h = avalanche(seed);
+  }
+  
+  hash = h;
+  hashed = true;
+  return h;
+}
@@ -0,0 +1,31 @@
+//
+//  content_hash.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__content_hash__
+#define __nbt_utils__content_hash__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nbt_utils.h"
+
+// Content hashes (Tag::contentHash) identify subtrees by value, e.g. to deduplicate sections, entities
+// or whole chunks in backups, or to tell changed subtrees apart cheaply when comparing trees (see diff()).
+// Different hashes prove the values differ, equal ones are only very likely equal values, so code that
+// can't afford a collision compares the tags after a match.
+//
+// The hash of a tag covers its type and payload: compounds combine the keys and hashes of their entries
+// regardless of their order and only count the last of repeated keys (the same notion of equality as
+// equalTags), lists combine their entry type and the hashes of their entries in order, arrays are hashed in bulk.
+// The name of the tag itself isn't part of it, so equal values hash the same wherever they are stored,
+// while the names of the entries below it are, as part of their compound.
+// Hashes are the same on every host and for arrays that were read lazily (see ByteReader::lazyArrays).
+
+namespace nbt {
+  //! 64-bit hash of a byte string (built like xxHash64, but not compatible with it)
+  uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+}
+
+#endif /* defined(__nbt_utils__content_hash__) */
@@ -0,0 +1,461 @@
+//
+//  diff.cpp
+//  nbt-utils
+//
+
+#include "diff.h"
+#include "snbt.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace nbt;
+
+#pragma mark - Equality
+
+template<typename T> static bool equalArrays(const Array<T> &a, const Array<T> &b) {
+  if(a.count != b.count) return false;
+  if(a.data == b.data || !a.count) return true;
+  if(a.wireOrder == b.wireOrder) return !memcmp(a.data.get(), b.data.get(), a.count * sizeof(T));
+  
+  for(size_t i = 0; i < a.count; ++i)
+    if(a.getElement(i) != b.getElement(i)) return false;
+  return true;
+}
+
+static bool equalCompounds(const TagHash &a, const TagHash &b) {
+  // Usually the keys are in the same order
+  bool sameOrder = a.size() == b.size();
+  for(auto i = a.begin(), j = b.begin(); sameOrder && i != a.end(); ++i, ++j) sameOrder = i->first == j->first;
+  
+  // Entries shadowed by a later one with the same key don't count
+  if(sameOrder) {
+    for(auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+      if(!equalTags(i->second.get(), j->second.get()) && a.find(i->first) == i) return false;
+    return true;
+  }
+  
+  for(auto it = a.begin(); it != a.end(); ++it) {
+    if(a.find(it->first) != it) continue;
+    auto other = b.find(it->first);
+    if(other == b.end() || !equalTags(it->second.get(), other->second.get())) return false;
+  }
+  
+  for(auto it = b.begin(); it != b.end(); ++it)
+    if(a.find(it->first) == a.end()) return false;
+  return true;
+}
+
+bool nbt::equalTags(const Tag *a, const Tag *b) {
+  if(a == b) return true;
+  if(a->tagType() != b->tagType()) return false;
+  // Cached hashes can prove tags different, but a match could be a collision and is checked below
+  if(a->hasContentHash() && b->hasContentHash() && a->contentHash() != b->contentHash()) return false;
+  
+  switch(a->tagType()) {
+#define do_case(type) case TagType::type: return ((const type##Tag *)a)->value == ((const type##Tag *)b)->value;
+      do_case(Byte);
+      do_case(Short);
+      do_case(Int);
+      do_case(Long);
+      do_case(String);
+#undef do_case
+    
+    // Bitwise, so NaN equals itself and 0 doesn't equal -0
+#define do_case(type) case TagType::type: return !memcmp(&((const type##Tag *)a)->value, &((const type##Tag *)b)->value, sizeof(((const type##Tag *)a)->value));
+      do_case(Float);
+      do_case(Double);
+#undef do_case
+    
+#define do_case(type) case TagType::type: return equalArrays(((const type##Tag *)a)->value, ((const type##Tag *)b)->value);
+      do_case(ByteArray);
+      do_case(IntArray);
+      do_case(LongArray);
+#undef do_case
+    
+    case TagType::List: {
+      const ListTag *la = (const ListTag *)a, *lb = (const ListTag *)b;
+      if(la->entryKind != lb->entryKind || la->value.size() != lb->value.size()) return false;
+      
+      for(size_t i = 0; i < la->value.size(); ++i)
+        if(!equalTags(la->value[i].get(), lb->value[i].get())) return false;
+      return true;
+    }
+    
+    case TagType::Compound: return equalCompounds(((const CompoundTag *)a)->value, ((const CompoundTag *)b)->value);
+    default: return true;
+  }
+}
+
+#pragma mark - Diff
+
+class Differ {
+public:
+  Differ(const DiffOptions &options, Patch &patch) : options(options), patch(patch) {}
+  
+  //! a and b have the same type
+  void diffTags(const Tag *a, const Tag *b) {
+    // Different hashes skip the comparison of everything below, equal ones are confirmed
+    if(a == b || (a->contentHash() == b->contentHash() && equalTags(a, b))) return;
+    
+    switch(a->tagType()) {
+      case TagType::Compound: diffCompounds(((const CompoundTag *)a)->value, ((const CompoundTag *)b)->value); break;
+      
+      case TagType::List: {
+        const ListTag *la = (const ListTag *)a, *lb = (const ListTag *)b;
+        if(la->entryKind != lb->entryKind) emit(PatchOp::Set, b);
+        else if(options.listKey.empty() || la->entryKind != TagType::Compound || !diffKeyed(la, lb)) diffIndexed(la, lb);
+        break;
+      }
+      
+      default: if(!equalTags(a, b)) emit(PatchOp::Set, b);
+    }
+  }
+  
+private:
+  const DiffOptions &options;
+  Patch &patch;
+  std::vector<Patch::Step> path;
+  
+  void emit(PatchOp::Enum op, const Tag *value = NULL) {
+    patch.edits.push_back(Patch::Edit());
+    Patch::Edit &edit = patch.edits.back();
+    
+    edit.op = op;
+    edit.path = path;
+    if(value) edit.value.reset(copyTag(value));
+  }
+  
+  void push(const Name &key) {
+    Patch::Step step;
+    step.kind = Patch::Step::Key;
+    step.key = key;
+    step.index = 0;
+    path.push_back(step);
+  }
+  
+  void push(size_t index) {
+    Patch::Step step;
+    step.kind = Patch::Step::Index;
+    step.index = (uint32_t)index;
+    path.push_back(step);
+  }
+  
+  void diffCompounds(const TagHash &a, const TagHash &b) {
+    // Only the last of several entries with the same key counts, like for lookups
+    for(auto it = a.begin(); it != a.end(); ++it) {
+      if(a.find(it->first) != it) continue;
+      auto other = b.find(it->first);
+      
+      push(it->first);
+      if(other == b.end()) emit(PatchOp::Remove);
+      else if(other->second->tagType() != it->second->tagType()) emit(PatchOp::Set, other->second.get());
+      else diffTags(it->second.get(), other->second.get());
+      path.pop_back();
+    }
+    
+    for(auto it = b.begin(); it != b.end(); ++it) {
+      if(b.find(it->first) != it || a.find(it->first) != a.end()) continue;
+      
+      push(it->first);
+      emit(PatchOp::Set, it->second.get());
+      path.pop_back();
+    }
+  }
+  
+  void diffIndexed(const ListTag *a, const ListTag *b) {
+    size_t na = a->value.size(), nb = b->value.size();
+    for(size_t i = 0; i < std::min(na, nb); ++i) {
+      push(i);
+      diffTags(a->value[i].get(), b->value[i].get());
+      path.pop_back();
+    }
+    
+    for(size_t i = na; i < nb; ++i) {
+      push(i);
+      emit(PatchOp::Insert, b->value[i].get());
+      path.pop_back();
+    }
+    
+    for(size_t i = na; i-- > nb;) {
+      push(i);
+      emit(PatchOp::Remove);
+      path.pop_back();
+    }
+  }
+  
+  //! Content hashes of the key field, false if an entry lacks it or a value occurs twice
+  bool collectKeys(const ListTag *list, std::vector<uint64_t> &keys, std::unordered_map<uint64_t, size_t> &indices) {
+    for(auto it = list->value.begin(); it != list->value.end(); ++it) {
+      const TagHash &hash = ((const CompoundTag *)it->get())->value;
+      auto field = hash.find(options.listKey);
+      if(field == hash.end()) return false;
+      
+      keys.push_back(field->second->contentHash());
+      if(!indices.insert(std::make_pair(keys.back(), keys.size() - 1)).second) return false;
+    }
+    return true;
+  }
+  
+  //! Matches the entries by the value of their key field: removes the ones that are gone, then walks b
+  //! and diffs entries that are already in place, moves (as a remove and an insert) the ones that
+  //! aren't and inserts new ones. False if the lists can't be matched this way.
+  bool diffKeyed(const ListTag *a, const ListTag *b) {
+    std::vector<uint64_t> keysA, keysB;
+    std::unordered_map<uint64_t, size_t> indicesA, indicesB;
+    if(!collectKeys(a, keysA, indicesA) || !collectKeys(b, keysB, indicesB)) return false;
+    
+    for(size_t i = keysA.size(); i-- > 0;)
+      if(!indicesB.count(keysA[i])) {
+        push(i);
+        emit(PatchOp::Remove);
+        path.pop_back();
+      }
+    
+    // What the list looks like after the edits so far
+    std::vector<std::pair<uint64_t, const Tag *>> current;
+    for(size_t i = 0; i < keysA.size(); ++i)
+      if(indicesB.count(keysA[i])) current.push_back(std::make_pair(keysA[i], a->value[i].get()));
+    
+    for(size_t j = 0; j < keysB.size(); ++j) {
+      const Tag *entry = b->value[j].get();
+      if(j < current.size() && current[j].first == keysB[j]) {
+        push(j);
+        diffTags(current[j].second, entry);
+        path.pop_back();
+        continue;
+      }
+      
+      size_t k = j + 1;
+      while(k < current.size() && current[k].first != keysB[j]) ++k;
+      if(k < current.size()) {
+        push(k);
+        emit(PatchOp::Remove);
+        path.pop_back();
+        current.erase(current.begin() + k);
+      }
+      
+      push(j);
+      emit(PatchOp::Insert, entry);
+      path.pop_back();
+      current.insert(current.begin() + j, std::make_pair(keysB[j], entry));
+    }
+    
+    return true;
+  }
+};
+
+Patch nbt::diff(const Tag *a, const Tag *b, const DiffOptions &options) {
+  if(a->tagType() != b->tagType()) throw "Can't diff tags of different types.";
+  
+  Patch patch;
+  Differ(options, patch).diffTags(a, b);
+  return patch;
+}
+
+#pragma mark - Apply
+
+static const char *const mismatch = "Patch doesn't match the tree.";
+
+static Tag *child(Tag *tag, const Patch::Step &step) {
+  if(step.kind == Patch::Step::Key) {
+    if(tag->tagType() != TagType::Compound) throw mismatch;
+    
+    TagHash &hash = ((CompoundTag *)tag)->value;
+    auto it = hash.find(step.key);
+    if(it == hash.end()) throw mismatch;
+    return it->second.get();
+  }
+  
+  if(tag->tagType() != TagType::List) throw mismatch;
+  
+  ListTag *list = (ListTag *)tag;
+  if(step.index >= list->value.size()) throw mismatch;
+  return list->value[step.index].get();
+}
+
+static void applyToCompound(CompoundTag *compound, const Patch::Edit &edit) {
+  const Name &key = edit.path.back().key;
+  TagHash &hash = compound->value;
+  
+  switch(edit.op) {
+    case PatchOp::Set: {
+      Tag *copy = copyTag(edit.value.get());
+      copy->name = key;
+      copy->hasName = true;
+      
+      std::shared_ptr<Tag> &entry = hash[key];
+      if(entry && entry->parent == compound) entry->parent = NULL;
+      entry.reset(copy);
+      copy->parent = compound;
+      break;
+    }
+    
+    case PatchOp::Remove: if(!hash.erase(key)) throw mismatch; break;
+    default: throw mismatch;
+  }
+}
+
+static void applyToList(ListTag *list, const Patch::Edit &edit) {
+  uint32_t index = edit.path.back().index;
+  size_t count = list->value.size();
+  
+  if(edit.op == PatchOp::Remove) {
+    if(index >= count) throw mismatch;
+    list->removeElement(index);
+    return;
+  }
+  
+  if(edit.op == PatchOp::Set ? index >= count : index > count) throw mismatch;
+  if(count && edit.value->tagType() != list->entryKind) throw mismatch; // Entries of a list have the same type
+  
+  std::shared_ptr<Tag> copy(copyTag(edit.value.get()));
+  copy->name = Name();
+  copy->hasName = false;
+  copy->parent = list;
+  
+  if(edit.op == PatchOp::Set) {
+    if(list->value[index]->parent == list) list->value[index]->parent = NULL;
+    list->value[index] = copy;
+  } else
+    list->value.insert(list->value.begin() + index, copy);
+  
+  list->entryKind = copy->tagType();
+  list->markDirty();
+}
+
+void Patch::apply(Tag *root) const {
+  for(auto it = edits.begin(); it != edits.end(); ++it) {
+    const Edit &edit = *it;
+    if(edit.op != PatchOp::Remove && !edit.value) throw "Patch is missing a value.";
+    
+    if(edit.path.empty()) {
+      if(edit.op != PatchOp::Set || edit.value->tagType() != root->tagType()) throw mismatch;
+      copyValue(root, edit.value.get());
+      continue;
+    }
+    
+    Tag *parent = root;
+    for(size_t i = 0; i + 1 < edit.path.size(); ++i) parent = child(parent, edit.path[i]);
+    
+    if(edit.path.back().kind == Step::Key) {
+      if(parent->tagType() != TagType::Compound) throw mismatch;
+      applyToCompound((CompoundTag *)parent, edit);
+    } else {
+      if(parent->tagType() != TagType::List) throw mismatch;
+      applyToList((ListTag *)parent, edit);
+    }
+  }
+}
+
+#pragma mark - Encoding
+
+std::string Patch::Edit::getPath() const {
+  std::string out;
+  for(auto it = path.begin(); it != path.end(); ++it) {
+    if(it->kind == Step::Index) {
+      out += '[';
+      appendInteger(out, it->index);
+      out += ']';
+      continue;
+    }
+    
+    if(it != path.begin()) out += '.';
+    
+    const std::string &key = it->key;
+    bool bare = !key.empty();
+    for(size_t i = 0; bare && i < key.length(); ++i) {
+      char c = key[i];
+      bare = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '-' || c == '+';
+    }
+    
+    if(bare) {
+      out += key;
+      continue;
+    }
+    
+    out += '"';
+    for(size_t i = 0; i < key.length(); ++i) {
+      if(key[i] == '"' || key[i] == '\\') out += '\\';
+      out += key[i];
+    }
+    out += '"';
+  }
+  return out;
+}
+
+std::basic_string<unsigned char> Patch::encode() const {
+  size_t size = 4;
+  for(auto it = edits.begin(); it != edits.end(); ++it) {
+    if(it->op != PatchOp::Remove && !it->value) throw "Patch is missing a value.";
+    
+    size += 1 + 2;
+    for(auto step = it->path.begin(); step != it->path.end(); ++step)
+      size += 1 + (step->kind == Step::Key ? 2 + step->key.length() : 4);
+    if(it->op != PatchOp::Remove) size += Tag::encodedSize(it->value.get(), false);
+  }
+  
+  std::basic_string<unsigned char> output(size, 0);
+  ByteWriter writer(&output[0], size);
+  
+  writer.writeU32((uint32_t)edits.size());
+  for(auto it = edits.begin(); it != edits.end(); ++it) {
+    writer.writeU8(it->op);
+    writer.writeU16((uint16_t)it->path.size());
+    
+    for(auto step = it->path.begin(); step != it->path.end(); ++step) {
+      writer.writeU8(step->kind);
+      if(step->kind == Step::Key) {
+        writer.writeU16((uint16_t)step->key.length());
+        writer.write(step->key.data(), step->key.length());
+      } else
+        writer.writeU32(step->index);
+    }
+    
+    if(it->op != PatchOp::Remove) Tag::write(it->value.get(), writer);
+  }
+  
+  return output;
+}
+
+Patch Patch::decode(const uint8_t *data, size_t size) {
+  ByteReader reader(data, size);
+  Patch patch;
+  
+  uint32_t count = reader.readU32();
+  patch.edits.reserve(std::min((size_t)count, reader.remaining() / 3)); // Every edit takes at least 3 bytes
+  
+  for(uint32_t i = 0; i < count; ++i) {
+    patch.edits.push_back(Edit());
+    Edit &edit = patch.edits.back();
+    
+    edit.op = (PatchOp::Enum)reader.readU8();
+    if(edit.op != PatchOp::Set && edit.op != PatchOp::Remove && edit.op != PatchOp::Insert) throw "Invalid patch: unknown operation.";
+    
+    uint16_t steps = reader.readU16();
+    edit.path.resize(steps);
+    for(uint16_t j = 0; j < steps; ++j) {
+      Step &step = edit.path[j];
+      uint8_t kind = reader.readU8();
+      
+      if(kind == Step::Key) {
+        uint16_t length = reader.readU16();
+        step.kind = Step::Key;
+        step.key = Name((const char *)reader.take(length), length);
+        step.index = 0;
+      } else if(kind == Step::Index) {
+        step.kind = Step::Index;
+        step.index = reader.readU32();
+      } else
+        throw "Invalid patch: unknown path step.";
+    }
+    
+    if(edit.op != PatchOp::Remove) {
+      edit.value.reset(Tag::read(reader, false));
+      if(!edit.value || edit.value->tagType() == TagType::End) throw "Invalid patch: missing value.";
+    }
+  }
+  
+  if(!reader.atEnd()) throw "Invalid patch: unexpected data at the end.";
+  return patch;
+}
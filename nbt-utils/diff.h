@@ -0,0 +1,84 @@
+//
+//  diff.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__diff__
+#define __nbt_utils__diff__
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "nbt_utils.h"
+
+namespace nbt {
+  struct PatchOp {
+#ifdef EMSCRIPTEN
+    // (emscripten)
+    // Using chars instead of an enum-values makes bindings easier.
+    
+    typedef char Enum;
+    enum Values : char {
+#else
+    enum Enum : char {
+#endif
+      Set    = 0, //!< Replaces a compound entry (or adds it, if there is none) or a list entry
+      Remove = 1, //!< Removes a compound entry or a list entry
+      Insert = 2  //!< Inserts a list entry in front of the given index (or appends it, if the index is the count)
+    };
+  };
+  
+  //! Edit script that turns one tree into another, see diff(). Edits are applied in order and
+  //! their list indices refer to the list as the earlier edits left it.
+  class Patch {
+  public:
+    struct Step {
+      enum Kind { Key, Index } kind;
+      Name key;       //!< Compound entry
+      uint32_t index; //!< List entry
+    };
+    
+    struct Edit {
+      PatchOp::Enum op;
+      std::vector<Step> path;     //!< Leads from the root to the changed entry, empty for the root itself
+      std::shared_ptr<Tag> value; //!< New value for Set and Insert, owned by the patch
+      
+      //! The path in query syntax (see Query), e.g. Level.Entities[3].Pos
+      std::string getPath() const;
+    };
+    
+    std::vector<Edit> edits;
+    
+    size_t size() const { return edits.size(); }
+    bool empty() const { return edits.empty(); }
+    
+    //! Replays the edits onto root. Values are copied, so the same patch can be applied to several trees.
+    //! Throws if the tree doesn't have the entries an edit refers to, the edits before it stay applied then.
+    void apply(Tag *root) const;
+    
+    //! Compact binary form: u32 edit count, then per edit the op (u8), the path (u16 step count, steps are
+    //! a u8 kind followed by a u16-length key or a u32 index) and for Set and Insert the value as an unnamed tag
+    std::basic_string<unsigned char> encode() const;
+    static Patch decode(const uint8_t *data, size_t size); //!< Throws if the data isn't a valid patch
+  };
+  
+  struct DiffOptions {
+    //! Lists of compounds that all have a unique value for this field (e.g. "UUID" or "id") are
+    //! matched by that value instead of by index, so entries that were added, removed or moved
+    //! only cause edits for themselves. Empty to always match by index.
+    std::string listKey;
+  };
+  
+  //! Edits that turn a into b (which have to be of the same type), changed leaves are replaced
+  //! as a whole. Applying them to a copy of a gives a tree equal to b, except that added compound
+  //! entries come after the existing ones. Content hashes tell changed subtrees apart without
+  //! comparing them, subtrees with equal hashes are compared to rule out a collision.
+  Patch diff(const Tag *a, const Tag *b, const DiffOptions &options = DiffOptions());
+  
+  //! Whether two tags have the same type and value, names of a and b themselves are not compared.
+  //! Compound entries are matched by key regardless of their order, of repeated keys only the last one counts.
+  bool equalTags(const Tag *a, const Tag *b);
+}
+
+#endif /* defined(__nbt_utils__diff__) */
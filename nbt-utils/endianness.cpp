@@ -8,6 +8,8 @@
 
 #include "endianness.h"
 
+#include <string.h>
+
 uint64_t htonll_impl(uint64_t input) {
   uint64_t rval = 42;
   if(*(char *)&rval != 42) return input;
@@ -24,4 +26,135 @@ uint64_t htonll_impl(uint64_t input) {
   data[7] = input >> 0;
   
   return rval;
-}
\ No newline at end of file
+}
+
+#pragma mark - Bulk conversion
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+
+// Network order already is host order.
+void swapCopy16(void *dst, const void *src, size_t count) { if(dst != src) memcpy(dst, src, count * 2); }
+void swapCopy32(void *dst, const void *src, size_t count) { if(dst != src) memcpy(dst, src, count * 4); }
+void swapCopy64(void *dst, const void *src, size_t count) { if(dst != src) memcpy(dst, src, count * 8); }
+
+#else
+
+#if defined(__GNUC__) || defined(__clang__)
+#define bswap16(x) __builtin_bswap16(x)
+#define bswap32(x) __builtin_bswap32(x)
+#define bswap64(x) __builtin_bswap64(x)
+#else
+#define bswap16(x) (uint16_t)(((x) >> 8) | ((x) << 8))
+#define bswap32(x) ntohl(x)
+#define bswap64(x) htonll_impl(x)
+#endif
+
+// Scalar kernels, also used for the tails the vector kernels leave over.
+// memcpy keeps unaligned access well-defined and compiles down to plain loads and stores.
+#define scalar_kernel(bits) \
+static void scalarSwap##bits(uint8_t *dst, const uint8_t *src, size_t count) { \
+  for(size_t i = 0; i < count; ++i) { \
+    uint##bits##_t v; \
+    memcpy(&v, src + i * (bits / 8), bits / 8); \
+    v = bswap##bits(v); \
+    memcpy(dst + i * (bits / 8), &v, bits / 8); \
+  } }
+  
+scalar_kernel(16)
+scalar_kernel(32)
+scalar_kernel(64)
+#undef scalar_kernel
+
+typedef void (*SwapKernel)(uint8_t *dst, const uint8_t *src, size_t count);
+
+struct SwapKernels {
+  SwapKernel swap16, swap32, swap64;
+};
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+
+// The shuffle masks reverse the bytes within each 2, 4 or 8 byte lane.
+static const uint8_t shuffleMasks[3][16] = {
+  { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+  { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+  { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+};
+
+#define sse_kernel(bits, mask) \
+__attribute__((target("ssse3"))) \
+static void ssse3Swap##bits(uint8_t *dst, const uint8_t *src, size_t count) { \
+  const __m128i shuffle = _mm_loadu_si128((const __m128i *)shuffleMasks[mask]); \
+  size_t bytes = count * (bits / 8), i = 0; \
+  for(; i + 16 <= bytes; i += 16) { \
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i)); \
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, shuffle)); \
+  } \
+  scalarSwap##bits(dst + i, src + i, (bytes - i) / (bits / 8)); }
+  
+#define avx2_kernel(bits, mask) \
+__attribute__((target("avx2"))) \
+static void avx2Swap##bits(uint8_t *dst, const uint8_t *src, size_t count) { \
+  const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)shuffleMasks[mask])); \
+  size_t bytes = count * (bits / 8), i = 0; \
+  for(; i + 64 <= bytes; i += 64) { \
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src + i)); \
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32)); \
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(a, shuffle)); \
+    _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_shuffle_epi8(b, shuffle)); \
+  } \
+  for(; i + 32 <= bytes; i += 32) { \
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i)); \
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(v, shuffle)); \
+  } \
+  scalarSwap##bits(dst + i, src + i, (bytes - i) / (bits / 8)); }
+  
+sse_kernel(16, 0)
+sse_kernel(32, 1)
+sse_kernel(64, 2)
+avx2_kernel(16, 0)
+avx2_kernel(32, 1)
+avx2_kernel(64, 2)
+#undef sse_kernel
+#undef avx2_kernel
+
+static SwapKernels selectKernels() {
+  __builtin_cpu_init();
+  
+  if(__builtin_cpu_supports("avx2")) {
+    SwapKernels k = { avx2Swap16, avx2Swap32, avx2Swap64 };
+    return k;
+  }
+  
+  if(__builtin_cpu_supports("ssse3")) {
+    SwapKernels k = { ssse3Swap16, ssse3Swap32, ssse3Swap64 };
+    return k;
+  }
+  
+  SwapKernels k = { scalarSwap16, scalarSwap32, scalarSwap64 };
+  return k;
+}
+
+#else
+
+static SwapKernels selectKernels() {
+  SwapKernels k = { scalarSwap16, scalarSwap32, scalarSwap64 };
+  return k;
+}
+
+#endif
+
+static const SwapKernels &kernels() {
+  static const SwapKernels k = selectKernels(); // Thread-safe initialization since C++11
+  return k;
+}
+
+void swapCopy16(void *dst, const void *src, size_t count) { kernels().swap16((uint8_t *)dst, (const uint8_t *)src, count); }
+void swapCopy32(void *dst, const void *src, size_t count) { kernels().swap32((uint8_t *)dst, (const uint8_t *)src, count); }
+void swapCopy64(void *dst, const void *src, size_t count) { kernels().swap64((uint8_t *)dst, (const uint8_t *)src, count); }
+
+#undef bswap16
+#undef bswap32
+#undef bswap64
+
+#endif
@@ -10,6 +10,7 @@
 #define __nbt_utils__endianness__
 
 #include <arpa/inet.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef htonll
@@ -18,4 +19,13 @@ uint64_t htonll_impl(uint64_t);
 #define ntohll htonll_impl
 #endif
 
+// Bulk conversion between big-endian (network) and host order, e.g. for array payloads.
+// Swapping is its own inverse, so the same kernels serve both directions.
+// dst and src may be the same buffer but must not overlap otherwise, neither needs to be aligned.
+// On x86 the best of AVX2, SSSE3 and plain C is picked at runtime.
+
+void swapCopy16(void *dst, const void *src, size_t count); //!< Converts count 16 bit values
+void swapCopy32(void *dst, const void *src, size_t count); //!< Converts count 32 bit values
+void swapCopy64(void *dst, const void *src, size_t count); //!< Converts count 64 bit values
+
 #endif /* defined(__nbt_utils__endianness__) */
\ No newline at end of file
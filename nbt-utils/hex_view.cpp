@@ -0,0 +1,77 @@
+//
+//  hex_view.cpp
+//  nbt-utils
+//
+
+#include "hex_view.h"
+
+#include <stdio.h>
+
+using namespace nbt;
+
+static const char *const HighlightBegin = "<font color=\"red\">";
+static const char *const HighlightEnd = "</font>";
+
+static void appendEscaped(std::string &out, char c) {
+  switch(c) {
+    case '&': out += "&amp;"; break;
+    case '<': out += "&lt;"; break;
+    case '>': out += "&gt;"; break;
+    case '"': out += "&quot;"; break;
+    case '\'': out += "&#039;"; break;
+    default: out += c;
+  }
+}
+
+std::string HexView::render(size_t firstRow, size_t rowCount, size_t selStart, size_t selEnd) const {
+  size_t rows = getRowCount();
+  if(firstRow > rows) firstRow = rows;
+  if(rowCount > rows - firstRow) rowCount = rows - firstRow;
+  
+  std::string out;
+  out.reserve(rowCount * (bytesPerRow * 4 + 64));
+  
+  for(size_t row = firstRow; row < firstRow + rowCount; ++row) renderRow(out, row, selStart, selEnd);
+  return out;
+}
+
+void HexView::renderRow(std::string &out, size_t row, size_t selStart, size_t selEnd) const {
+  static const char digits[] = "0123456789abcdef";
+  const std::basic_string<unsigned char> &bytes = *data;
+  
+  size_t begin = row * bytesPerRow;
+  size_t end = begin + bytesPerRow < bytes.length() ? begin + bytesPerRow : bytes.length();
+  
+  char address[24];
+  snprintf(address, sizeof(address), "0x%04zx: ", begin);
+  out += address;
+  
+  // Hex part, a highlighted byte takes its trailing space along
+  bool open = false;
+  for(size_t i = begin; i < end; ++i) {
+    bool selected = i >= selStart && i < selEnd;
+    if(selected != open) out += (open = selected) ? HighlightBegin : HighlightEnd;
+    
+    out += digits[bytes[i] >> 4];
+    out += digits[bytes[i] & 15];
+    out += ' ';
+  }
+  if(open) out += HighlightEnd;
+  out.append((begin + bytesPerRow - end) * 3, ' ');
+  
+  out += "| ";
+  
+  // Printable ASCII part
+  open = false;
+  for(size_t i = begin; i < end; ++i) {
+    bool selected = i >= selStart && i < selEnd;
+    if(selected != open) out += (open = selected) ? HighlightBegin : HighlightEnd;
+    
+    char c = bytes[i] >= 0x20 && bytes[i] <= 0x7e ? (char)bytes[i] : '.';
+    appendEscaped(out, c);
+  }
+  if(open) out += HighlightEnd;
+  out.append(begin + bytesPerRow - end, ' ');
+  
+  out += '\n';
+}
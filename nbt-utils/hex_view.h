@@ -0,0 +1,49 @@
+//
+//  hex_view.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__hex_view__
+#define __nbt_utils__hex_view__
+
+#include <string>
+
+#include "nbt_utils.h"
+
+namespace nbt {
+  //! Hex dump for a hex panel: keeps the serialized tree and formats any window of rows as
+  //!
+  //!     0x0000: 0a 00 04 72 6f 6f 74 01 00 01 62 05 | ...root...b.
+  //!
+  //! with the selected byte range wrapped in <font color="red"> and the text HTML-escaped,
+  //! so only the rows that are actually on screen are ever turned into a string.
+  class HexView {
+  public:
+    explicit HexView(size_t bytesPerRow = 12)
+    : bytesPerRow(bytesPerRow ? bytesPerRow : 1), data(std::make_shared<std::basic_string<unsigned char>>()) {}
+    
+    //! Serializes the tree again. The top tag caches its output, so only changed subtrees are re-encoded,
+    //! and the view shares that buffer with it instead of keeping a copy.
+    void update(Tag *root, TagType::Enum type = TagType::Unknown) { data = Tag::serializeShared(root, type); }
+    void setData(const uint8_t *bytes, size_t size) { data = std::make_shared<std::basic_string<unsigned char>>(bytes, size); }
+    
+    const std::basic_string<unsigned char> &getData() const { return *data; }
+    size_t getSize() const { return data->length(); }
+    
+    size_t getBytesPerRow() const { return bytesPerRow; }
+    size_t getRowCount() const { return (data->length() + bytesPerRow - 1) / bytesPerRow; }
+    size_t rowOf(size_t index) const { return index / bytesPerRow; } //!< Row that shows the byte at index
+    
+    //! Rows [firstRow, firstRow + rowCount) (clamped to the data), each terminated by a newline.
+    //! Bytes in [selStart, selEnd) are highlighted, pass an empty range for no selection.
+    std::string render(size_t firstRow, size_t rowCount, size_t selStart, size_t selEnd) const;
+    
+  private:
+    void renderRow(std::string &out, size_t row, size_t selStart, size_t selEnd) const;
+    
+    size_t bytesPerRow;
+    std::shared_ptr<const std::basic_string<unsigned char>> data;
+  };
+}
+
+#endif /* defined(__nbt_utils__hex_view__) */
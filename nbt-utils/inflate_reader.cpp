@@ -0,0 +1,60 @@
+//
+//  inflate_reader.cpp
+//  nbt-utils
+//
+
+#include "inflate_reader.h"
+
+#include <algorithm>
+
+using namespace nbt;
+
+InflateReader::InflateReader(const uint8_t *data, size_t size, size_t windowSize)
+: ByteReader(NULL, 0), window(windowSize), finished(false) {
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.avail_in = (uInt)size;
+  strm.next_in = const_cast<uint8_t *>(data); // zlib does not write to the input
+  
+  // +32 lets zlib detect gzip and zlib headers by itself.
+  if(inflateInit2(&strm, MAX_WBITS | 32) != Z_OK) throw "zlib inflateInit failed.";
+  
+  begin = cursor = end = window.data();
+}
+
+InflateReader::~InflateReader() {
+  inflateEnd(&strm);
+}
+
+void InflateReader::fill(size_t n) {
+  // Move what hasn't been consumed yet to the front of the window and account for the rest.
+  size_t unread = end - cursor;
+  base += cursor - begin;
+  memmove(window.data(), cursor, unread);
+  
+  // The window only grows while the stream keeps delivering data, so a length field that promises
+  // more than the input holds ends in an error rather than in allocating what it claims up front.
+  while(unread < n && !finished) {
+    if(unread == window.size()) window.resize(std::min(n, window.size() * 2));
+    
+    size_t space = std::min(window.size() - unread, (size_t)UINT32_MAX);
+    strm.next_out = window.data() + unread;
+    strm.avail_out = (uInt)space;
+    
+    int zret = inflate(&strm, Z_NO_FLUSH);
+    switch(zret) {
+      case Z_STREAM_END: finished = true; break;
+      case Z_OK: break;
+      case Z_BUF_ERROR: finished = true; break; // No progress possible, the input is truncated.
+      default: throw "zlib inflate error.";
+    }
+    
+    unread += space - strm.avail_out;
+  }
+  
+  begin = cursor = window.data();
+  end = begin + unread;
+  
+  if(unread < n) throw "Unexpected end of NBT data.";
+}
@@ -0,0 +1,37 @@
+//
+//  inflate_reader.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__inflate_reader__
+#define __nbt_utils__inflate_reader__
+
+#include <vector>
+#include <zlib.h>
+
+#include "byte_reader.h"
+
+namespace nbt {
+  //! ByteReader that decompresses gzip or zlib data on demand into a small sliding window,
+  //! so the decompressed document never has to exist in memory as a whole.
+  //! The window only grows beyond windowSize if a single field (e.g. a large array) needs it.
+  class InflateReader : public ByteReader {
+  public:
+    //! The compressed input is borrowed and has to outlive the reader
+    InflateReader(const uint8_t *data, size_t size, size_t windowSize = 64 << 10);
+    virtual ~InflateReader();
+    
+  protected:
+    virtual void fill(size_t n);
+    
+  private:
+    InflateReader(const InflateReader &);
+    InflateReader &operator=(const InflateReader &);
+    
+    z_stream strm;
+    std::vector<uint8_t> window;
+    bool finished;
+  };
+}
+
+#endif /* defined(__nbt_utils__inflate_reader__) */
@@ -0,0 +1,128 @@
+//
+//  interned_name.cpp
+//  nbt-utils
+//
+
+#include "interned_name.h"
+
+#include <vector>
+#include <mutex>
+
+using namespace nbt;
+
+namespace {
+  // The pool is split into shards with their own lock, so threads decoding different
+  // documents at the same time rarely wait for each other.
+  const size_t ShardCount = 16;
+  
+  template<typename Entry>
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Entry *> buckets;
+    size_t size;
+    
+    Shard() : buckets(64, (Entry *)NULL), size(0) {}
+    
+    Entry *&bucket(size_t hash) { return buckets[(hash / ShardCount) & (buckets.size() - 1)]; }
+    
+    void grow() {
+      std::vector<Entry *> old(buckets.size() * 2, (Entry *)NULL);
+      old.swap(buckets);
+      
+      for(size_t i = 0; i < old.size(); ++i) {
+        for(Entry *e = old[i], *next; e; e = next) {
+          next = e->next;
+          Entry *&head = bucket(e->hash);
+          e->next = head;
+          head = e;
+        }
+      }
+    }
+  };
+}
+
+size_t Name::hashOf(const char *data, size_t length) {
+  // FNV-1a, names are short so this beats anything fancier
+  uint64_t hash = 14695981039346656037ull;
+  for(size_t i = 0; i < length; ++i) {
+    hash ^= (uint8_t)data[i];
+    hash *= 1099511628211ull;
+  }
+  return (size_t)(hash ^ (hash >> 32));
+}
+
+const std::string &Name::emptyString() {
+  static const std::string empty;
+  return empty;
+}
+
+// Function-local so the pool is ready even for Names created during static initialization
+template<typename Entry>
+static Shard<Entry> *shards() {
+  static Shard<Entry> pool[ShardCount];
+  return pool;
+}
+
+Name::Entry *Name::intern(const char *data, size_t length) {
+  if(length == 0) return NULL;
+  
+  size_t hash = hashOf(data, length);
+  Shard<Entry> &shard = shards<Entry>()[hash % ShardCount];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  
+  Entry *&head = shard.bucket(hash);
+  for(Entry *e = head; e; e = e->next) {
+    if(e->hash == hash && e->text.length() == length && !memcmp(e->text.data(), data, length)) {
+      // Entries are unlinked as soon as their count drops to zero, so this never revives a dying one.
+      e->refs.fetch_add(1, std::memory_order_relaxed);
+      return e;
+    }
+  }
+  
+  Entry *e = new Entry();
+  e->refs.store(1, std::memory_order_relaxed);
+  e->hash = hash;
+  e->text.assign(data, length);
+  e->next = head;
+  head = e;
+  
+  if(++shard.size > shard.buckets.size()) shard.grow();
+  return e;
+}
+
+void Name::release() {
+  if(!entry) return;
+  
+  // Dropping a reference that isn't the last one doesn't need the lock. The last one does, because
+  // intern() might be handing out a new reference to this entry at the same time.
+  size_t refs = entry->refs.load(std::memory_order_relaxed);
+  while(refs > 1)
+    if(entry->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed)) {
+      entry = NULL;
+      return;
+    }
+  
+  Shard<Entry> &shard = shards<Entry>()[entry->hash % ShardCount];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  
+  if(entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    Entry **link = &shard.bucket(entry->hash);
+    while(*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    
+    --shard.size;
+    delete entry;
+  }
+  
+  entry = NULL;
+}
+
+size_t Name::poolSize() {
+  size_t size = 0;
+  for(size_t i = 0; i < ShardCount; ++i) {
+    Shard<Entry> &shard = shards<Entry>()[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.size;
+  }
+  return size;
+}
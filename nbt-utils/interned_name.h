@@ -0,0 +1,71 @@
+//
+//  interned_name.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__interned_name__
+#define __nbt_utils__interned_name__
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+
+namespace nbt {
+  //! Reference-counted handle to a string in a process-wide pool, so every tag and compound key
+  //! with the same name shares one allocation no matter which document it belongs to.
+  //! Equal names are the same pool entry, which makes comparing two Names a pointer compare.
+  //! Handles can be copied and destroyed from any thread; the empty name never touches the pool.
+  class Name {
+  public:
+    Name() : entry(NULL) {}
+    Name(const char *data, size_t length) : entry(intern(data, length)) {}
+    Name(const std::string &str) : entry(intern(str.data(), str.length())) {}
+    Name(const char *str) : entry(intern(str, strlen(str))) {}
+    
+    Name(const Name &other) : entry(other.entry) { retain(); }
+    Name(Name &&other) : entry(other.entry) { other.entry = NULL; }
+    ~Name() { release(); }
+    
+    Name &operator=(Name other) { swap(other); return *this; }
+    void swap(Name &other) { Entry *e = entry; entry = other.entry; other.entry = e; }
+    
+    const std::string &str() const { return entry ? entry->text : emptyString(); }
+    operator const std::string &() const { return str(); }
+    
+    const char *data() const { return str().data(); }
+    const char *c_str() const { return str().c_str(); }
+    size_t length() const { return str().length(); }
+    bool empty() const { return entry == NULL; }
+    
+    size_t hash() const { return entry ? entry->hash : hashOf("", 0); }
+    static size_t hashOf(const char *data, size_t length); //!< The hash a Name with this text has
+    
+    bool operator==(const Name &other) const { return entry == other.entry; }
+    bool operator!=(const Name &other) const { return entry != other.entry; }
+    bool operator==(const std::string &other) const { return str() == other; }
+    bool operator!=(const std::string &other) const { return str() != other; }
+    bool operator==(const char *other) const { return str() == other; }
+    bool operator!=(const char *other) const { return str() != other; }
+    
+    static size_t poolSize(); //!< Number of distinct names currently alive
+    
+  private:
+    struct Entry {
+      std::atomic<size_t> refs;
+      size_t hash;
+      std::string text;
+      Entry *next; //!< Next entry in the same pool bucket
+    };
+    
+    static Entry *intern(const char *data, size_t length);
+    static const std::string &emptyString();
+    
+    void retain() { if(entry) entry->refs.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+    
+    Entry *entry;
+  };
+}
+
+#endif /* defined(__nbt_utils__interned_name__) */
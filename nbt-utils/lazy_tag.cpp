@@ -0,0 +1,171 @@
+//
+//  lazy_tag.cpp
+//  nbt-utils
+//
+
+#include "lazy_tag.h"
+
+#include <stdlib.h>
+
+using namespace nbt;
+
+#pragma mark - LazyDocument
+
+LazyDocument::LazyDocument(std::string &input, bool withName, TagType::Enum type) {
+  storage.swap(input);
+  data = (const uint8_t *)storage.data();
+  size = storage.length();
+  parseHeader(withName, type);
+}
+
+LazyDocument::LazyDocument(const uint8_t *data, size_t size, bool withName, TagType::Enum type) : data(data), size(size) {
+  parseHeader(withName, type);
+}
+
+void LazyDocument::parseHeader(bool withName, TagType::Enum type) {
+  ByteReader reader(data, size);
+  
+  bool hasTypeByte = type == TagType::Unknown;
+  if(hasTypeByte) type = (TagType::Enum)reader.readU8();
+  if(type < TagType::End || type > TagType::LongArray) throw "Unknown NBT tag type.";
+  
+  std::string name;
+  if(withName && type != TagType::End) {
+    uint16_t nameLength = reader.readU16();
+    name.assign((const char *)reader.take(nameLength), nameLength);
+  }
+  
+  root.reset(new LazyTag(this, type, hasTypeByte, withName, 0, reader.tell(), type == TagType::End ? reader.tell() : 0));
+  root->name.swap(name);
+}
+
+#pragma mark - LazyTag
+
+size_t LazyTag::getEndIndex() const {
+  if(!endIndex) {
+    ByteReader reader(document->getData() + payloadIndex, document->getSize() - payloadIndex, payloadIndex);
+    Tag::skipPayload(reader, type);
+    endIndex = reader.tell();
+  }
+  return endIndex;
+}
+
+ByteReader LazyTag::payloadReader() const {
+  return ByteReader(document->getData() + payloadIndex, document->getSize() - payloadIndex, payloadIndex);
+}
+
+size_t LazyTag::getCount() const {
+  switch(type) {
+    case TagType::Compound: const_cast<LazyTag *>(this)->index(); return children.size();
+    case TagType::List: {
+      ByteReader reader = payloadReader();
+      TagType::Enum entryKind;
+      return Tag::readListHeader(reader, entryKind);
+    }
+    case TagType::ByteArray:
+    case TagType::IntArray:
+    case TagType::LongArray: return payloadReader().readU32();
+    default: return 0;
+  }
+}
+
+TagType::Enum LazyTag::getEntryKind() const {
+  if(type != TagType::List) return TagType::End;
+  return (TagType::Enum)payloadReader().readU8();
+}
+
+void LazyTag::index() {
+  if(indexed) return;
+  
+  // Only marked as indexed once the scan got through, so a truncated subtree throws on every access
+  children.clear();
+  ByteReader reader = payloadReader();
+  if(type == TagType::Compound) {
+    TagType::Enum childType;
+    size_t childStart;
+    while((childStart = reader.tell(), childType = (TagType::Enum)reader.readU8()) != TagType::End) {
+      uint16_t nameLength = reader.readU16();
+      const char *childName = (const char *)reader.take(nameLength);
+      
+      size_t childPayload = reader.tell();
+      Tag::skipPayload(reader, childType);
+      
+      children.push_back(LazyTag(document, childType, true, true, childStart, childPayload, reader.tell()));
+      children.back().name.assign(childName, nameLength);
+    }
+    endIndex = reader.tell();
+  } else if(type == TagType::List) {
+    TagType::Enum entryKind;
+    uint32_t count = Tag::readListHeader(reader, entryKind);
+    
+    // Entries of fixed-size lists are located arithmetically in getElement instead.
+    size_t fixedSize = Tag::fixedPayloadSize(entryKind);
+    if(fixedSize) {
+      reader.skip(fixedSize * count);
+    } else if(entryKind != TagType::End) {
+      children.reserve(count);
+      for(uint32_t i = 0; i < count; ++i) {
+        size_t entryStart = reader.tell();
+        Tag::skipPayload(reader, entryKind);
+        children.push_back(LazyTag(document, entryKind, false, false, entryStart, entryStart, reader.tell()));
+      }
+    }
+    endIndex = reader.tell();
+  }
+  indexed = true;
+}
+
+LazyTag *LazyTag::get(const std::string &key) {
+  if(type != TagType::Compound) return NULL;
+  
+  index();
+  for(auto it = children.rbegin(); it != children.rend(); ++it) // The last duplicate wins, like in CompoundTag
+    if(it->name == key) return &*it;
+  return NULL;
+}
+
+LazyTag *LazyTag::getElement(size_t i) {
+  if(type != TagType::List) return NULL;
+  
+  // Also checks that all entries are there before any is located arithmetically
+  index();
+  
+  TagType::Enum entryKind = getEntryKind();
+  size_t fixedSize = Tag::fixedPayloadSize(entryKind);
+  if(!fixedSize) return i < children.size() ? &children[i] : NULL;
+  
+  if(i >= getCount()) return NULL;
+  
+  auto it = fixedEntries.find(i);
+  if(it == fixedEntries.end()) {
+    size_t entryStart = payloadIndex + 1 + 4 + i * fixedSize;
+    it = fixedEntries.insert(std::make_pair(i, LazyTag(document, entryKind, false, false, entryStart, entryStart, entryStart + fixedSize))).first;
+  }
+  return &it->second;
+}
+
+LazyTag *LazyTag::find(const std::string &path) {
+  LazyTag *tag = this;
+  size_t begin = 0;
+  while(tag && begin <= path.length()) {
+    size_t end = path.find('.', begin);
+    if(end == std::string::npos) end = path.length();
+    
+    std::string step = path.substr(begin, end - begin);
+    if(tag->type == TagType::List) {
+      char *stepEnd;
+      unsigned long i = strtoul(step.c_str(), &stepEnd, 10);
+      tag = step.empty() || *stepEnd ? NULL : tag->getElement(i);
+    } else
+      tag = tag->get(step);
+      
+    begin = end + 1;
+  }
+  return tag;
+}
+
+Tag *LazyTag::materialize() const {
+  size_t end = getEndIndex();
+  ByteReader reader(document->getData() + startIndex, end - startIndex, startIndex);
+  return Tag::read(reader, hasName, hasTypeByte ? TagType::Unknown : type);
+}
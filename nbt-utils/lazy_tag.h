@@ -0,0 +1,94 @@
+//
+//  lazy_tag.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__lazy_tag__
+#define __nbt_utils__lazy_tag__
+
+#include "nbt_utils.h"
+
+namespace nbt {
+  class LazyDocument;
+  
+  //! Read-only view of an encoded tag inside a LazyDocument.
+  //! The direct children of a compound or list are located by a structural scan the first time
+  //! they are accessed, payloads are only decoded when the tag is materialized.
+  //! Accessors throw if the scan runs into truncated or invalid data, every time they are called.
+  class LazyTag {
+  public:
+    TagType::Enum tagType() const { return type; }
+    
+    const std::string &getName() const { return name; }
+    bool getHasName() const { return hasName; }
+    
+    size_t getStartIndex() const { return startIndex; }
+    size_t getPayloadIndex() const { return payloadIndex; }
+    size_t getEndIndex() const;
+    
+    //! Number of entries for compounds, lists and arrays, 0 otherwise
+    size_t getCount() const;
+    TagType::Enum getEntryKind() const; //!< Entry type of a list, End otherwise
+    
+    LazyTag *get(const std::string &key);  //!< Child of a compound, NULL if there is none
+    LazyTag *getElement(size_t i);         //!< Entry of a list, NULL if out of range
+    
+    //! Follows a dotted path such as "Data.Player.Inventory.0", NULL if any step is missing
+    LazyTag *find(const std::string &path);
+    
+    //! Reader positioned at the start of the payload, e.g. for fetching a single scalar
+    ByteReader payloadReader() const;
+    
+    //! Decodes this subtree into a regular heap allocated tag that the caller owns
+    Tag *materialize() const;
+    
+  private:
+    friend class LazyDocument;
+    
+    LazyTag(const LazyDocument *document, TagType::Enum type, bool hasTypeByte, bool hasName,
+            size_t startIndex, size_t payloadIndex, size_t endIndex)
+    : document(document), type(type), hasTypeByte(hasTypeByte), hasName(hasName), indexed(false),
+      startIndex(startIndex), payloadIndex(payloadIndex), endIndex(endIndex) {}
+      
+    void index();
+    
+    const LazyDocument *document;
+    TagType::Enum type;
+    bool hasTypeByte, hasName, indexed;
+    std::string name;
+    
+    size_t startIndex, payloadIndex;
+    mutable size_t endIndex; //!< 0 until known
+    
+    std::vector<LazyTag> children;         //!< Compound children and entries of variable sized lists
+    std::map<size_t, LazyTag> fixedEntries; //!< Entries of fixed-size lists that have been accessed
+  };
+  
+  //! Holds the encoded bytes a tree of LazyTags points into
+  class LazyDocument {
+  public:
+    //! Takes over the buffer (the string is swapped out and left empty)
+    LazyDocument(std::string &data, bool withName = true, TagType::Enum type = TagType::Unknown);
+    
+    //! Borrows the buffer, which has to outlive the document
+    LazyDocument(const uint8_t *data, size_t size, bool withName = true, TagType::Enum type = TagType::Unknown);
+    
+    LazyTag &getRoot() { return *root; }
+    
+    const uint8_t *getData() const { return data; }
+    size_t getSize() const { return size; }
+    
+  private:
+    LazyDocument(const LazyDocument &);
+    LazyDocument &operator=(const LazyDocument &);
+    
+    void parseHeader(bool withName, TagType::Enum type);
+    
+    std::string storage;
+    const uint8_t *data;
+    size_t size;
+    std::unique_ptr<LazyTag> root;
+  };
+}
+
+#endif /* defined(__nbt_utils__lazy_tag__) */
@@ -7,25 +7,44 @@
 //
 
 #include "nbt_utils.h"
+#include "query.h"
+#include "packed_indices.h"
+#include "snbt.h"
+#include "diff.h"
 using namespace nbt;
 
 #ifndef EMSCRIPTEN
 #pragma mark Standalone example
 #include <fstream>
 int main(int argc, const char * argv[]) {
+  if(argc < 2) {
+    fprintf(stderr, "usage: %s <file.nbt>\n", argv[0]);
+    return 1;
+  }
+  
   std::ifstream is;
-  is.open("/Users/alex/Desktop/level.dat", std::ios::binary);
+  is.open(argv[1], std::ios::binary);
+  if(!is) {
+    fprintf(stderr, "%s: could not open %s\n", argv[0], argv[1]);
+    return 1;
+  }
   
   std::stringstream buffer;
   buffer << is.rdbuf();
   
-  Tag *t = Tag::deserializeCompressed(buffer.str());
-  std::string out = Tag::serializeCompressed(t);
-  
-  std::stringstream ostream {};
-  Tag::write(t, ostream, "Example");
-  
-  printf("%p\n", t);
+  try {
+    DataFormat format;
+    Tag *t = Tag::load(buffer.str(), &format);
+    auto out = Tag::save(t, format.compression);
+    
+    printf("%s\n", toSNBT(t, SNBTStyle::Pretty).c_str());
+    printf("%zu bytes in, %zu bytes out\n", buffer.str().length(), out.length());
+    
+    delete t;
+  } catch(const char *error) {
+    fprintf(stderr, "%s: %s\n", argv[1], error);
+    return 1;
+  }
   
   return 0;
 }
@@ -35,6 +54,40 @@ int main(int argc, const char * argv[]) {
 
 using namespace emscripten;
 
+//! 64-bit values don't cross into JavaScript, so hashes do so as 16 hex digits
+static std::string contentHash(const Tag &tag) {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)tag.contentHash());
+  return hex;
+}
+
+#pragma mark Packed indices
+
+//! Uint16Array with count indices unpacked from a LongArray tag
+static val unpackTag(const LongArrayTag &tag, size_t count, unsigned bits, PackedLayout::Enum layout) {
+  std::vector<uint16_t> indices = unpackIndices(tag.value, count, bits, layout);
+  return val(typed_memory_view(indices.size(), indices.data())).call<val>("slice");
+}
+
+//! Packs a Uint16Array (or plain array) of indices into a LongArray tag
+static void packTag(LongArrayTag *tag, const val &values, unsigned bits, PackedLayout::Enum layout) {
+  std::vector<uint16_t> indices(values["length"].as<size_t>());
+  val(typed_memory_view(indices.size(), indices.data())).call<void>("set", values);
+  packIndices(tag, indices.data(), indices.size(), bits, layout);
+}
+
+#pragma mark Patches
+
+static Patch diffTags(const Tag *a, const Tag *b, const std::string &listKey) {
+  DiffOptions options;
+  options.listKey = listKey;
+  return diff(a, b, options);
+}
+
+static Patch decodePatch(const std::string &data) { return Patch::decode((const uint8_t *)data.data(), data.length()); }
+static PatchOp::Enum patchOp(const Patch &patch, size_t i) { return patch.edits.at(i).op; }
+static std::string patchPath(const Patch &patch, size_t i) { return patch.edits.at(i).getPath(); }
+
 EMSCRIPTEN_BINDINGS(my_module) {
   function("makeTag", &makeTag, allow_raw_pointers());
   
@@ -46,6 +99,9 @@ EMSCRIPTEN_BINDINGS(my_module) {
   .class_function("serializeCompressed", &Tag::serializeCompressed, allow_raw_pointers())
   .class_function("deserialize", &Tag::deserialize, allow_raw_pointer<ret_val>())
   .class_function("deserializeCompressed", &Tag::deserializeCompressed, allow_raw_pointers())
+  .class_function("toSNBT", &toSNBT, allow_raw_pointers())
+  .class_function("parseSNBT", select_overload<Tag *(const std::string &)>(&parseSNBT), allow_raw_pointer<ret_val>())
+  .class_function("save", select_overload<std::basic_string<unsigned char>(Tag *, Compression::Enum, TagType::Enum)>(&Tag::save), allow_raw_pointers())
   .function("getName", &Tag::getName)
   .function("setName", &Tag::setName)
   .function("hasName", &Tag::getHasName)
@@ -53,6 +109,30 @@ EMSCRIPTEN_BINDINGS(my_module) {
   .function("getStartIndex", &Tag::getStartIndex)
   .function("getEndIndex", &Tag::getEndIndex)
   .function("tagType", &Tag::tagType)
+  .function("markDirty", &Tag::markDirty)
+  .function("getContentHash", &contentHash)
+  ;
+  
+  class_<Query>("Query")
+  .constructor<std::string>()
+  .function("first", &Query::first, allow_raw_pointers())
+  .function("count", &Query::count, allow_raw_pointers())
+  .function("getPath", &Query::getPath)
+  ;
+  
+  function("packedLength", &packedLength);
+  function("bitsForPalette", &bitsForPalette);
+  function("unpackIndices", &unpackTag);
+  function("packIndices", &packTag, allow_raw_pointers());
+  
+  class_<Patch>("Patch")
+  .class_function("diff", &diffTags, allow_raw_pointers())
+  .class_function("decode", &decodePatch)
+  .function("apply", &Patch::apply, allow_raw_pointers())
+  .function("encode", &Patch::encode)
+  .function("size", &Patch::size)
+  .function("getOp", &patchOp)
+  .function("getPath", &patchPath)
   ;
   
 #define array_class(klass) \
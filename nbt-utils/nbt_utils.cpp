@@ -7,29 +7,14 @@
 //
 
 #include "nbt_utils.h"
+#include "snbt.h"
 
 #include <iostream>
+#include <iterator>
+#include <algorithm>
 #include <vector>
 #include <map>
 
-int64_t ntoh64(int64_t input) {
-  uint64_t rval;
-  uint8_t *data = (uint8_t *)&rval;
-  data[0] = input >> 56;
-  data[1] = input >> 48;
-  data[2] = input >> 40;
-  data[3] = input >> 32;
-  data[4] = input >> 24;
-  data[5] = input >> 16;
-  data[6] = input >> 8;
-  data[7] = input >> 0;
-  return rval;
-}
-
-int64_t hton64(int64_t input) {
-  return ntoh64(input);
-}
-
 namespace nbt {
   class Tag;
 }
@@ -61,269 +46,751 @@ Tag *nbt::makeTag(TagType::Enum type) {
   return tag;
 }
 
-Tag *Tag::read(std::istream &stream, bool withName, TagType::Enum type) {
-  size_t startIndex = stream.tellg();
-  if(type == TagType::Unknown) stream.get((char &)type);
-  if(type == 0) {
-    Tag *t = new EndTag();
-    t->startIndex = startIndex;
-    t->endIndex = startIndex+1;
-    return t;
+std::shared_ptr<Tag> nbt::makeSharedTag(TagType::Enum type, Arena *arena) {
+  if(!arena) return std::shared_ptr<Tag>(makeTag(type));
+  
+  // allocate_shared puts the control block and the tag into a single arena allocation.
+  switch(type) {
+#define do_case(type) case TagType::type: return std::allocate_shared<type##Tag>(ArenaAllocator<type##Tag>(arena));
+      do_case(End);
+      
+      do_case(Byte);
+      do_case(Short);
+      do_case(Int);
+      do_case(Long);
+      do_case(Float);
+      do_case(Double);
+      do_case(ByteArray);
+      do_case(String);
+      do_case(List);
+      do_case(Compound);
+      do_case(IntArray);
+      do_case(LongArray);
+#undef do_case
+    default: return std::shared_ptr<Tag>();
   }
+}
+
+Tag *nbt::copyTag(const Tag *tag) {
+  Tag *copy = makeTag(tag->tagType());
+  copy->name = tag->name;
+  copy->hasName = tag->hasName;
+  copyValue(copy, tag);
+  return copy;
+}
+
+template<typename T> static void copyArray(Array<T> &dst, const Array<T> &src) {
+  dst.allocate(src.count);
+  if(!src.count) return;
+  
+  if(src.wireOrder) Array<T>::convertOrder(dst.data.get(), src.data.get(), src.count);
+  else memcpy(dst.data.get(), src.data.get(), src.count * sizeof(T));
+}
+
+void nbt::copyValue(Tag *dst, const Tag *src) {
+  if(dst->tagType() != src->tagType()) throw "Can't copy the value of a tag of a different type.";
+  
+  switch(src->tagType()) {
+#define do_case(type) case TagType::type: ((type##Tag *)dst)->setValue(((const type##Tag *)src)->value); break;
+      do_case(Byte);
+      do_case(Short);
+      do_case(Int);
+      do_case(Long);
+      do_case(Float);
+      do_case(Double);
+      do_case(String);
+#undef do_case
+#define do_case(type) case TagType::type: copyArray(((type##Tag *)dst)->value, ((const type##Tag *)src)->value); dst->markDirty(); break;
+      do_case(ByteArray);
+      do_case(IntArray);
+      do_case(LongArray);
+#undef do_case
+      
+    case TagType::List: {
+      ListTag *list = (ListTag *)dst;
+      const ListTag *source = (const ListTag *)src;
+      
+      list->clear();
+      list->entryKind = source->entryKind;
+      list->value.reserve(source->value.size());
+      for(auto it = source->value.begin(); it != source->value.end(); ++it) {
+        list->value.push_back(std::shared_ptr<Tag>(copyTag(it->get())));
+        list->value.back()->parent = list;
+      }
+      break;
+    }
+      
+    case TagType::Compound: {
+      TagHash &hash = ((CompoundTag *)dst)->value;
+      const TagHash &source = ((const CompoundTag *)src)->value;
+      
+      hash.clear();
+      for(auto it = source.begin(); it != source.end(); ++it)
+        hash.append(it->first, std::shared_ptr<Tag>(copyTag(it->second.get())));
+      break;
+    }
+      
+    default: break;
+  }
+}
+
+TagType::Enum Tag::readHeader(ByteReader &reader, bool withName, TagType::Enum type, Name &name) {
+  if(type == TagType::Unknown) type = (TagType::Enum)reader.readU8();
+  if(type == TagType::End) return type;
   
-  std::string name;
   if(withName) {
-    uint16_t nameLength;
-    stream.read((char *)&nameLength, 2);
-    
-    nameLength = ntohs(nameLength);
-    
-    char nameBuf[nameLength+1];
-    nameBuf[nameLength] = 0;
-    
-    stream.read(nameBuf, nameLength);
-    
-    name = nameBuf;
-  } else
-    name = "";
+    uint16_t nameLength = reader.readU16();
+    name = Name((const char *)reader.take(nameLength), nameLength);
+  }
+  
+  return type;
+}
+
+void Tag::readBody(ByteReader &reader, Name &name, bool withName, size_t startIndex) {
+  size_t payloadIndex = reader.tell();
+  readPayload(reader);
+  
+  this->name.swap(name);
+  this->hasName = withName && tagType() != TagType::End;
+  
+  this->startIndex = startIndex;
+  this->endIndex = reader.tell();
+  this->headerSize = (uint32_t)(payloadIndex - startIndex);
+  this->shift = 0;
+  this->dirty = false;
+}
+
+Tag *Tag::read(ByteReader &reader, bool withName, TagType::Enum type) {
+  size_t startIndex = reader.tell();
+  
+  Name name;
+  type = readHeader(reader, withName, type, name);
   
   Tag *tag = makeTag(type);
-  tag->readPayload(stream);
+  if(!tag) throw "Unknown NBT tag type.";
   
-  tag->name = name;
-  tag->hasName = withName;
+  try {
+    tag->readBody(reader, name, withName, startIndex);
+  } catch(...) {
+    delete tag;
+    throw;
+  }
   
-  tag->startIndex = startIndex;
-  tag->endIndex = stream.tellg();
+  return tag;
+}
+
+std::shared_ptr<Tag> Tag::readShared(ByteReader &reader, bool withName, TagType::Enum type) {
+  size_t startIndex = reader.tell();
+  
+  Name name;
+  type = readHeader(reader, withName, type, name);
+  
+  std::shared_ptr<Tag> tag = makeSharedTag(type, reader.arena);
+  if(!tag) throw "Unknown NBT tag type.";
   
+  tag->readBody(reader, name, withName, startIndex);
   return tag;
 }
 
-void Tag::write(Tag *tag, std::ostream &stream, TagType::Enum type) {
-  tag->startIndex = stream.tellp();
+Tag *Tag::read(std::istream &stream, bool withName, TagType::Enum type) {
+  std::streamoff startIndex = stream.tellg();
+  std::string buffer((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+  
+  bool seekable = startIndex >= 0;
+  ByteReader reader((const uint8_t *)buffer.data(), buffer.length(), seekable ? (size_t)startIndex : 0);
+  Tag *tag = read(reader, withName, type);
   
-  if(type == TagType::Unknown) stream.put(tag->tagType());
-  tag->writePayload(stream);
+  stream.clear();
+  if(seekable) stream.seekg(reader.tell());
   
-  tag->endIndex = stream.tellp();
+  return tag;
 }
 
-void Tag::write(Tag *tag, std::ostream &stream, const std::string &name, TagType::Enum type) {
-  tag->startIndex = stream.tellp();
+//! Whether data holds exactly one well-formed tag, checked structurally without decoding anything
+static bool isCompleteTag(const uint8_t *data, size_t size, bool withName) {
+  try {
+    ByteReader reader(data, size);
+    TagType::Enum type = (TagType::Enum)reader.readU8();
+    if(type == TagType::End) return false;
+    
+    Tag::skip(reader, withName, type);
+    return reader.atEnd();
+  } catch(const char *) {
+    return false;
+  }
+}
+
+Tag *Tag::load(const std::string &input, DataFormat *format, bool lazyArrays) {
+  Compression::Enum compression = detectCompression((const uint8_t *)input.data(), input.length());
   
-  if(type == TagType::Unknown) stream.put(tag->tagType());
+  // Lazy arrays keep pointing into the buffer, so it has to be owned by the tags.
+  std::shared_ptr<std::string> buffer;
+  if(compression != Compression::None) buffer = std::make_shared<std::string>(zlibInflate(input));
+  else if(lazyArrays) buffer = std::make_shared<std::string>(input);
   
-  uint16_t nameLength = htons((uint16_t)name.length());
-  stream.write((char *)&nameLength, 2);
-  stream << name;
+  const uint8_t *data = (const uint8_t *)(buffer ? buffer->data() : input.data());
+  size_t size = buffer ? buffer->length() : input.length();
   
-  tag->writePayload(stream);
+  // Named roots are the norm, only fall back to unnamed if that's the only way the bytes make sense.
+  bool withName = isCompleteTag(data, size, true) || !isCompleteTag(data, size, false);
+  
+  ByteReader reader(data, size);
+  if(lazyArrays) {
+    reader.lazyArrays = true;
+    reader.keepalive = buffer;
+  }
   
-  tag->endIndex = stream.tellp();
+  Tag *tag = read(reader, withName);
+  if(format) {
+    format->compression = compression;
+    format->withName = withName;
+  }
+  return tag;
 }
 
-template<> void ListTagBase::readPayload(std::istream &) {}
-template<> void ListTagBase::writePayload(std::ostream &) const {}
+size_t Tag::fixedPayloadSize(TagType::Enum type) {
+  switch(type) {
+    case TagType::Byte: return 1;
+    case TagType::Short: return 2;
+    case TagType::Int: return 4;
+    case TagType::Long: return 8;
+    case TagType::Float: return 4;
+    case TagType::Double: return 8;
+    default: return 0;
+  }
+}
 
-void ListTag::readPayload(std::istream &stream) {
-  stream.get((char &)entryKind);
+void Tag::skip(ByteReader &reader, bool withName, TagType::Enum type) {
+  if(type == TagType::Unknown) type = (TagType::Enum)reader.readU8();
+  if(type == TagType::End) return;
   
-  uint32_t count;
-  stream.read((char *)&count, 4);
-  count = ntohl(count);
+  if(withName) reader.skip(reader.readU16());
+  skipPayload(reader, type);
+}
+
+void Tag::skipPayload(ByteReader &reader, TagType::Enum type) {
+  switch(type) {
+    case TagType::End: break;
+    case TagType::Byte:
+    case TagType::Short:
+    case TagType::Int:
+    case TagType::Long:
+    case TagType::Float:
+    case TagType::Double: reader.skip(fixedPayloadSize(type)); break;
+    case TagType::ByteArray: reader.skip(reader.readU32()); break;
+    case TagType::String: reader.skip(reader.readU16()); break;
+    case TagType::IntArray: reader.skip((size_t)reader.readU32() * 4); break;
+    case TagType::LongArray: reader.skip((size_t)reader.readU32() * 8); break;
+    case TagType::List: {
+      TagType::Enum entryKind;
+      uint32_t count = readListHeader(reader, entryKind);
+      skipEntries(reader, entryKind, count);
+      break;
+    }
+    case TagType::Compound: {
+      TagType::Enum childType;
+      while((childType = (TagType::Enum)reader.readU8()) != TagType::End) {
+        reader.skip(reader.readU16());
+        skipPayload(reader, childType);
+      }
+      break;
+    }
+    default: throw "Unknown NBT tag type.";
+  }
+}
+
+void Tag::skipEntries(ByteReader &reader, TagType::Enum entryKind, uint32_t count) {
+  size_t size = fixedPayloadSize(entryKind);
+  if(size) reader.skip(size * count);
+  else if(entryKind != TagType::End)
+    for(uint32_t i = 0; i < count; ++i) skipPayload(reader, entryKind);
+}
+
+uint32_t Tag::readListHeader(ByteReader &reader, TagType::Enum &entryKind) {
+  entryKind = (TagType::Enum)reader.readU8();
+  uint32_t count = reader.readU32();
+  if(entryKind == TagType::End && count > 0) throw "List of EndTags can't have entries.";
+  return count;
+}
+
+void Tag::write(Tag *tag, ByteWriter &writer, TagType::Enum type) {
+  tag->dropEncoding(); // The indices are about to refer to a different output
+  writeTag(tag, writer, NULL, type);
+}
+
+void Tag::write(Tag *tag, ByteWriter &writer, const std::string &name, TagType::Enum type) {
+  tag->dropEncoding();
+  writeTag(tag, writer, &name, type);
+}
+
+void Tag::writeTag(Tag *tag, ByteWriter &writer, const std::string *name, TagType::Enum type) {
+  size_t startIndex = writer.tell();
   
-  value.resize(count);
-  for(uint32_t i = 0; i < count; ++i) {
-    size_t startIndex = stream.tellg();
-    Tag *t = Tag::read(stream, false, entryKind);
-    t->startIndex = startIndex;
-    t->endIndex = stream.tellg();
-    value[i].reset(t);
+  if(type == TagType::Unknown) writer.writeU8(tag->tagType());
+  if(name) {
+    writer.writeU16((uint16_t)name->length());
+    writer.write(name->data(), name->length());
+  }
+  
+  size_t headerSize = writer.tell() - startIndex;
+  
+  if(writer.previous && !tag->dirty) {
+    // The payload is unchanged, so copy it over. Instead of visiting the whole subtree to update its indices,
+    // remember how far it moved; the header is always fresh, since the key might have changed.
+    size_t payloadIndex = tag->startIndex + tag->headerSize;
+    writer.write(writer.previous + payloadIndex + tag->shift + writer.previousShift, tag->endIndex - payloadIndex);
+    
+    tag->shift = (ptrdiff_t)(startIndex + headerSize) - (ptrdiff_t)payloadIndex;
+    tag->startIndex = startIndex - tag->shift;
+    tag->headerSize = (uint32_t)headerSize;
+    return;
+  }
+  
+  // Children find themselves in the previous output through the shifts of all their ancestors.
+  ptrdiff_t outerShift = writer.previousShift;
+  writer.previousShift += tag->shift;
+  tag->writePayload(writer);
+  writer.previousShift = outerShift;
+  
+  tag->startIndex = startIndex;
+  tag->endIndex = writer.tell();
+  tag->headerSize = (uint32_t)headerSize;
+  tag->shift = 0;
+  tag->dirty = false;
+}
+
+std::shared_ptr<const std::basic_string<unsigned char>> Tag::serializeShared(Tag *tag, TagType::Enum type) {
+  // Only the top of a tree keeps its output, writing a subtree on its own invalidates that.
+  bool top = tag->parent == NULL;
+  if(!top) tag->dropEncoding();
+  
+  auto output = std::make_shared<std::basic_string<unsigned char>>(encodedSize(tag, tag->hasName, type), 0);
+  ByteWriter writer(&(*output)[0], output->length());
+  if(top && tag->encoding) writer.previous = tag->encoding->data();
+  
+  writeTag(tag, writer, tag->hasName ? &tag->name.str() : NULL, type);
+  
+  if(top) tag->encoding = output;
+  return output;
+}
+
+ptrdiff_t Tag::accumulatedShift() const {
+  ptrdiff_t shift = 0;
+  for(const Tag *t = this; t; t = t->parent) shift += t->shift;
+  return shift;
+}
+
+void Tag::dropEncoding() {
+  Tag *top = this;
+  while(top->parent) top = top->parent;
+  top->encoding.reset();
+}
+
+void Tag::markSubtreeDirty() {
+  dirty = false; // So that markDirty() reaches the ancestors
+  markDirty();
+  
+  if(tagType() == TagType::Compound) {
+    TagHash &hash = ((CompoundTag *)this)->value;
+    for(auto it = hash.begin(); it != hash.end(); ++it) it->second->markSubtreeDirty();
+  } else if(tagType() == TagType::List) {
+    std::vector<std::shared_ptr<Tag>> &list = ((ListTag *)this)->value;
+    for(auto it = list.begin(); it != list.end(); ++it) (*it)->markSubtreeDirty();
   }
 }
 
-void ListTag::writePayload(std::ostream &stream) const {
-  stream.put(entryKind);
+void Tag::write(Tag *tag, std::ostream &stream, TagType::Enum type) {
+  std::streamoff base = stream.tellp();
+  std::vector<uint8_t> buffer(encodedSize(tag, false, type));
   
-  uint32_t j = (uint32_t)value.size();
-  uint32_t count = htonl(j);
-  stream.write((char *)&count, 4);
+  ByteWriter writer(buffer.data(), buffer.size(), base >= 0 ? (size_t)base : 0);
+  write(tag, writer, type);
+  stream.write((const char *)buffer.data(), buffer.size());
+}
+
+void Tag::write(Tag *tag, std::ostream &stream, const std::string &name, TagType::Enum type) {
+  std::streamoff base = stream.tellp();
+  std::vector<uint8_t> buffer(encodedSize(tag, false, type) + 2 + name.length());
+  
+  ByteWriter writer(buffer.data(), buffer.size(), base >= 0 ? (size_t)base : 0);
+  write(tag, writer, name, type);
+  stream.write((const char *)buffer.data(), buffer.size());
+}
+
+template<> void ListTagBase::readPayload(ByteReader &) {}
+template<> void ListTagBase::writePayload(ByteWriter &) const {}
+template<> size_t ListTagBase::payloadSize() const { return 0; }
+
+void ListTag::readPayload(ByteReader &reader) {
+  uint32_t count = readListHeader(reader, entryKind);
+  
+  // Every entry takes at least one byte (EndTag lists are empty), so don't trust absurd counts.
+  value.clear();
+  value.reserve(std::min((size_t)count, reader.remaining()));
+  for(uint32_t i = 0; i < count; ++i) {
+    value.push_back(Tag::readShared(reader, false, entryKind));
+    value.back()->parent = this;
+  }
+}
+
+void ListTag::writePayload(ByteWriter &writer) const {
+  writer.writeU8(entryKind);
+  writer.writeU32((uint32_t)value.size());
   
-  for(uint32_t i = 0; i < j; ++i) {
-    value[i]->startIndex = stream.tellp();
-    value[i]->writePayload(stream);
-    value[i]->endIndex = stream.tellp();
+  for(auto it = value.begin(); it != value.end(); ++it) {
+    (*it)->parent = (Tag *)this; // In case the element was put in without a setter
+    writeTag(it->get(), writer, NULL, entryKind);
   }
 }
 
+size_t ListTag::payloadSize() const {
+  size_t size = 1 + 4;
+  for(auto it = value.begin(); it != value.end(); ++it) size += (*it)->encodedPayloadSize();
+  return size;
+}
+
+ListTag::~ListTag() {
+  for(auto it = value.begin(); it != value.end(); ++it)
+    if((*it)->parent == this) (*it)->parent = NULL;
+}
+
+void ListTag::clear() {
+  for(auto it = value.begin(); it != value.end(); ++it)
+    if((*it)->parent == this) (*it)->parent = NULL;
+  
+  value.clear();
+  markDirty();
+}
+
+void ListTag::removeElement(size_t i) {
+  if(value[i]->parent == this) value[i]->parent = NULL;
+  value.erase(value.begin() + i);
+  markDirty();
+}
+
 #pragma mark - Payload parsing
 
-#define rd_payload(klass) template<> void nbt::klass::readPayload(std::istream &stream)
-#define wr_payload(klass) template<> void nbt::klass::writePayload(std::ostream &stream) const
-
-rd_payload(ByteTag) { stream.get((char &)value); }
-wr_payload(ByteTag) { stream.put(value); }
-
-rd_payload(ShortTag) {
-  int16_t value;
-  stream.read((char *)&value, 2);
-  this->value = ntohs(value); }
-wr_payload(ShortTag) {
-  int16_t value = htons(this->value);
-  stream.write((char *)&value, 2); }
-
-rd_payload(IntTag) {
-  int32_t value;
-  stream.read((char *)&value, 4);
-  this->value = ntohl(value); }
-wr_payload(IntTag) {
-  int32_t value = htonl(this->value);
-  stream.write((char *)&value, 4); }
-
-rd_payload(LongTag) {
-  int64_t value;
-  stream.read((char *)&value, 8);
-  this->value = ntohll(value); }
-wr_payload(LongTag) {
-  int64_t value = htonll(this->value);
-  stream.write((char *)&value, 8); }
-
-rd_payload(FloatTag) { uint32_t val; stream.read((char *)&val, 4); val = ntohl(val); this->value = *(float *)&val; }
-wr_payload(FloatTag) { uint32_t val = htonl(*(uint32_t *)&this->value); stream.write((char *)&val, 4); }
-
-rd_payload(DoubleTag) { uint64_t val; stream.read((char *)&val, 8); val = ntohll(val); this->value = *(double *)&val; }
-wr_payload(DoubleTag) { uint64_t val = htonll(*(uint64_t *)&this->value); stream.write((char *)&val, 8); }
-
-rd_payload(ByteArrayTag) {
-  uint32_t count;
-  stream.read((char *)&count, 4);
-  count = ntohl(count);
-  
-  value.count = count;
-  value.data.reset((uint8_t *)malloc(count));
-  stream.read((char *)value.data.get(), count); }
-wr_payload(ByteArrayTag) {
-  uint32_t count = htonl(value.count);
-  stream.write((char *)&count, 4);
-  stream.write((char *)value.data.get(), value.count); }
+template<typename T>
+static void readArray(ByteReader &reader, Array<T> &array) {
+  uint32_t count = reader.readU32();
+  const uint8_t *src = reader.take((size_t)count * sizeof(T));
+  
+  if(reader.lazyArrays && reader.keepalive) {
+    // Shares ownership of the input, but points at the payload.
+    array.data = std::shared_ptr<T>(reader.keepalive, (T *)src);
+    array.count = count;
+    array.borrowed = true;
+    array.wireOrder = sizeof(T) > 1;
+    return;
+  }
+  
+  array.allocate(count, reader.arena);
+  if(reader.lazyArrays) {
+    memcpy(array.data.get(), src, (size_t)count * sizeof(T));
+    array.wireOrder = sizeof(T) > 1;
+  } else
+    Array<T>::convertOrder(array.data.get(), (const T *)src, count);
+}
 
-rd_payload(StringTag) {
-  uint16_t count;
-  stream.read((char *)&count, 2);
-  count = ntohs(count);
+template<typename T>
+static void writeArray(ByteWriter &writer, const Array<T> &array) {
+  writer.writeU32((uint32_t)array.count);
   
-  char buffer[count];
-  stream.read(buffer, count);
-  this->value = std::string(buffer, count); }
+  uint8_t *dst = writer.reserve(array.count * sizeof(T));
+  if(array.wireOrder) memcpy(dst, array.data.get(), array.count * sizeof(T));
+  else Array<T>::convertOrder((T *)dst, array.data.get(), array.count);
+}
+
+#define rd_payload(klass) template<> void nbt::klass::readPayload(ByteReader &reader)
+#define wr_payload(klass) template<> void nbt::klass::writePayload(ByteWriter &writer) const
+#define payload_size(klass) template<> size_t nbt::klass::payloadSize() const
+
+rd_payload(ByteTag) { value = (int8_t)reader.readU8(); }
+wr_payload(ByteTag) { writer.writeU8(value); }
+payload_size(ByteTag) { return 1; }
+
+rd_payload(ShortTag) { value = (int16_t)reader.readU16(); }
+wr_payload(ShortTag) { writer.writeU16(value); }
+payload_size(ShortTag) { return 2; }
+
+rd_payload(IntTag) { value = (int32_t)reader.readU32(); }
+wr_payload(IntTag) { writer.writeU32(value); }
+payload_size(IntTag) { return 4; }
+
+rd_payload(LongTag) { value = (int64_t)reader.readU64(); }
+wr_payload(LongTag) { writer.writeU64(value); }
+payload_size(LongTag) { return 8; }
+
+rd_payload(FloatTag) { uint32_t val = reader.readU32(); memcpy(&value, &val, 4); }
+wr_payload(FloatTag) { uint32_t val; memcpy(&val, &value, 4); writer.writeU32(val); }
+payload_size(FloatTag) { return 4; }
+
+rd_payload(DoubleTag) { uint64_t val = reader.readU64(); memcpy(&value, &val, 8); }
+wr_payload(DoubleTag) { uint64_t val; memcpy(&val, &value, 8); writer.writeU64(val); }
+payload_size(DoubleTag) { return 8; }
+
+rd_payload(ByteArrayTag) { readArray(reader, value); }
+wr_payload(ByteArrayTag) { writeArray(writer, value); }
+payload_size(ByteArrayTag) { return 4 + value.count; }
+
+rd_payload(StringTag) {
+  uint16_t count = reader.readU16();
+  value.assign((const char *)reader.take(count), count); }
 wr_payload(StringTag) {
-  uint16_t count = htons(value.length());
-  stream.write((char *)&count, 2);
-  stream << value; }
+  writer.writeU16((uint16_t)value.length());
+  writer.write(value.data(), (uint16_t)value.length()); }
+payload_size(StringTag) { return 2 + (uint16_t)value.length(); }
 
 rd_payload(CompoundTag) {
-  while(true) {
-    Tag *e = Tag::read(stream, true);
-    if(e->tagType() == 0) break; // EndTag
-    value[e->name] = std::shared_ptr<Tag>(e); // What about multiple tags with the same name?
-  } }
+  while(reader.peekU8() != TagType::End) {
+    std::shared_ptr<Tag> e = Tag::readShared(reader, true);
+    value.append(e->name, e);
+  }
+  reader.skip(1); }
 wr_payload(CompoundTag) {
+  for(auto it = value.begin(); it != value.end(); ++it) {
+    it->second->parent = (Tag *)this; // In case the entry was put in without a setter
+    writeTag(it->second.get(), writer, &it->first.str(), TagType::Unknown);
+  }
+  
+  writer.writeU8(TagType::End); }
+payload_size(CompoundTag) {
+  size_t size = 1; // EndTag
   for(auto it = value.begin(); it != value.end(); ++it)
-    Tag::write(it->second.get(), stream, it->first);
-  
-  EndTag e;
-  Tag::write(&e, stream); }
-
-rd_payload(IntArrayTag) {
-  uint32_t count;
-  stream.read((char *)&count, 4);
-  count = ntohl(count);
-  
-  value.count = count;
-  value.data.reset((int32_t *)(malloc(count * 4)));
-  stream.read((char *)value.data.get(), count * 4);
-  for(uint32_t i = 0; i < count; ++i) value.data.get()[i] = ntohl(value.data.get()[i]); }
-wr_payload(IntArrayTag) {
-  uint32_t output[value.count];
-  for(uint32_t i = 0; i < value.count; ++i) output[i] = htonl(value.data.get()[i]);
-  
-  uint32_t count = htonl(value.count);
-  stream.write((char *)&count, 4);
-  stream.write((char *)output, value.count * 4); }
-
-rd_payload(LongArrayTag) {
-  uint32_t count;
-  stream.read((char *)&count, 4);
-  count = ntohl(count);
-  
-  value.count = count;
-  value.data.reset((int64_t *)(malloc(count * 8)));
-  stream.read((char *)value.data.get(), count * 8);
-  for(uint32_t i = 0; i < count; ++i) value.data.get()[i] = ntoh64(value.data.get()[i]); }
-wr_payload(LongArrayTag) {
-  uint64_t output[value.count];
-  for(uint32_t i = 0; i < value.count; ++i) output[i] = hton64(value.data.get()[i]);
-  
-  uint32_t count = htonl(value.count);
-  stream.write((char *)&count, 4);
-  stream.write((char *)output, value.count * 8); }
+    size += 1 + 2 + it->first.length() + it->second->encodedPayloadSize();
+  return size; }
+
+rd_payload(IntArrayTag) { readArray(reader, value); }
+wr_payload(IntArrayTag) { writeArray(writer, value); }
+payload_size(IntArrayTag) { return 4 + value.count * 4; }
+
+rd_payload(LongArrayTag) { readArray(reader, value); }
+wr_payload(LongArrayTag) { writeArray(writer, value); }
+payload_size(LongArrayTag) { return 4 + value.count * 8; }
 
 #undef rd_payload
 #undef wr_payload
+#undef payload_size
 
 #pragma mark - Array
+// Text forms for the editor: bytes as space separated hex pairs, everything else as space separated decimals.
+
 template<> std::string U8Array::serialize() const {
-  std::stringstream ss;
-  ss << std::hex << std::setfill('0');
-  for(size_t i = 0; i < count; ++i)
-    ss << std::setw(2) << static_cast<unsigned>(data.get()[i]) << " ";
-  return ss.str();
+  static const char hex[] = "0123456789abcdef";
+  
+  std::string out(count * 3, ' ');
+  for(size_t i = 0; i < count; ++i) {
+    uint8_t byte = data.get()[i];
+    out[i*3] = hex[byte >> 4];
+    out[i*3+1] = hex[byte & 15];
+  }
+  return out;
+}
+
+static int hexDigit(char c) {
+  if(c >= '0' && c <= '9') return c - '0';
+  if((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+  throw "Expected hexadecimal digits.";
 }
 
 template<> void U8Array::deserialize(std::string str) {
-  std::stringstream ss(str);
   size_t count = (str.length()+1) / 3; // +1 to account for a possibly missing space at the end.
   resize(count);
   
-  for(size_t i = 0; i < count; ++i) {
-    uint8_t byte = ((str[i*3] - '0') << 4) | (str[i*3+1] - '0');
-    data.get()[i] = byte;
+  for(size_t i = 0; i < count; ++i)
+    data.get()[i] = (uint8_t)(hexDigit(str[i*3]) << 4 | hexDigit(str[i*3+1]));
+}
+
+template<typename T> static std::string serializeIntegers(const Array<T> &array) {
+  std::string out;
+  out.reserve(array.count * 4);
+  for(size_t i = 0; i < array.count; ++i) {
+    appendInteger(out, array.getElement(i));
+    out += ' ';
+  }
+  return out;
+}
+
+template<typename T> static void deserializeIntegers(Array<T> &array, const std::string &str) {
+  std::vector<T> values;
+  const char *p = str.data(), *end = p + str.length();
+  
+  for(;;) {
+    while(p != end && *p == ' ') ++p;
+    if(p == end) break;
     
-    //ss >> std::hex >> (unsigned &)data.get()[i];
+    int64_t value;
+    if(!(p = parseInteger(p, end, value))) throw "Expected space separated integers.";
+    values.push_back((T)value);
   }
+  
+  array.allocate(values.size());
+  if(!values.empty()) memcpy(array.data.get(), values.data(), values.size() * sizeof(T));
+  array.markDirty();
 }
 
-template<> std::string I32Array::serialize() const {
-  std::stringstream ss;
-  for(size_t i = 0; i < count; ++i) ss << data.get()[i] << " ";
-  return ss.str();
+template<> std::string I32Array::serialize() const { return serializeIntegers(*this); }
+template<> void I32Array::deserialize(std::string str) { deserializeIntegers(*this, str); }
+
+template<> std::string I64Array::serialize() const { return serializeIntegers(*this); }
+template<> void I64Array::deserialize(std::string str) { deserializeIntegers(*this, str); }
+
+#pragma mark - Hash
+
+void nbt::adoptValue(TagHash &hash, Tag *owner) {
+  hash.owner = owner;
+  for(auto it = hash.begin(); it != hash.end(); ++it)
+    if(it->second) it->second->parent = owner;
+}
+
+TagHash::~TagHash() {
+  for(auto it = entries.begin(); it != entries.end(); ++it)
+    if(owner && it->second && it->second->parent == owner) it->second->parent = NULL;
 }
 
-template<> void I32Array::deserialize(std::string str) {
-  size_t count = std::count(str.begin(), str.end(), ' ');
-  if(*str.rbegin() != ' ')
-    ++count; // Our last character is not a delimiter, so we didn't account for one number.
+void TagHash::clear() {
+  for(auto it = entries.begin(); it != entries.end(); ++it)
+    if(owner && it->second && it->second->parent == owner) it->second->parent = NULL;
   
-  std::stringstream ss(str);
-  resize(count);
-  for(size_t i = 0; i < count; ++i)
-    ss >> data.get()[i];
+  entries.clear();
+  slots.clear();
+  if(owner) owner->markDirty();
+}
+
+size_t TagHash::indexOf(const Name &key) const {
+  if(slots.empty()) {
+    for(size_t i = entries.size(); i-- > 0;)
+      if(entries[i].first == key) return i;
+    return npos;
+  }
+  
+  size_t mask = slots.size() - 1;
+  for(size_t s = key.hash() & mask; slots[s]; s = (s + 1) & mask)
+    if(entries[slots[s] - 1].first == key) return slots[s] - 1;
+  return npos;
 }
 
-template<> std::string I64Array::serialize() const {
-  std::stringstream ss;
-  for(size_t i = 0; i < count; ++i) ss << data.get()[i] << " ";
-  return ss.str();
+size_t TagHash::indexOf(const std::string &key) const {
+  size_t hash = Name::hashOf(key.data(), key.length());
+  
+  if(slots.empty()) {
+    for(size_t i = entries.size(); i-- > 0;)
+      if(entries[i].first.hash() == hash && entries[i].first == key) return i;
+    return npos;
+  }
+  
+  size_t mask = slots.size() - 1;
+  for(size_t s = hash & mask; slots[s]; s = (s + 1) & mask) {
+    const Name &name = entries[slots[s] - 1].first;
+    if(name.hash() == hash && name == key) return slots[s] - 1;
+  }
+  return npos;
 }
 
-template<> void I64Array::deserialize(std::string str) {
-  size_t count = std::count(str.begin(), str.end(), ' ');
-  if(*str.rbegin() != ' ')
-    ++count; // Our last character is not a delimiter, so we didn't account for one number.
+std::shared_ptr<Tag> &TagHash::operator[](const Name &key) {
+  if(owner) owner->markDirty();
   
-  std::stringstream ss(str);
-  resize(count);
-  for(size_t i = 0; i < count; ++i)
-    ss >> data.get()[i];
+  size_t i = indexOf(key);
+  if(i != npos) return entries[i].second;
+  
+  append(key, std::shared_ptr<Tag>());
+  return entries.back().second;
+}
+
+void TagHash::append(const Name &key, const std::shared_ptr<Tag> &tag) {
+  if(owner) {
+    if(tag) tag->parent = owner;
+    owner->markDirty();
+  }
+  
+  Entry entry;
+  entry.first = key;
+  entry.second = tag;
+  entries.push_back(entry);
+  
+  if(entries.size() > IndexThreshold) {
+    if(entries.size() * 2 > slots.size()) rebuildIndex(); // Keeps the load factor at or below 1/2
+    else insertSlot(entries.size() - 1);
+  }
+}
+
+TagHash::iterator TagHash::erase(iterator it) {
+  if(owner) {
+    if(it->second && it->second->parent == owner) it->second->parent = NULL;
+    owner->markDirty();
+  }
+  
+  size_t i = it - entries.begin();
+  entries.erase(it);
+  
+  // The entries behind it moved, so their slots are stale anyway.
+  if(!slots.empty()) rebuildIndex();
+  return entries.begin() + i;
+}
+
+size_t TagHash::erase(const std::string &key) {
+  size_t count = 0;
+  for(size_t i = entries.size(); i-- > 0;)
+    if(entries[i].first == key) {
+      erase(entries.begin() + i);
+      ++count;
+    }
+  
+  return count;
+}
+
+void TagHash::jsRename(std::string oldKey, std::string newKey) {
+  size_t i = indexOf(oldKey);
+  if(i == npos || oldKey == newKey) return;
+  
+  Name name(newKey);
+  std::vector<Entry> renamed;
+  renamed.reserve(entries.size());
+  
+  for(size_t j = 0; j < entries.size(); ++j) {
+    if(j == i) {
+      renamed.push_back(entries[j]);
+      renamed.back().first = name;
+    } else if(entries[j].first != name)
+      renamed.push_back(entries[j]);
+    else if(owner && entries[j].second && entries[j].second->parent == owner)
+      entries[j].second->parent = NULL;
+  }
+  
+  entries.swap(renamed);
+  rebuildIndex();
+  if(owner) owner->markDirty();
+}
+
+void TagHash::jsSet(std::string key, Tag *tag) {
+  // The tag might come from another tree, so its indices can't be trusted.
+  tag->markSubtreeDirty();
+  
+  std::shared_ptr<Tag> &entry = (*this)[key];
+  if(entry && entry->parent == owner) entry->parent = NULL;
+  
+  entry = std::shared_ptr<Tag>(tag);
+  tag->parent = owner;
+}
+
+void TagHash::rebuildIndex() {
+  slots.clear();
+  if(entries.size() <= IndexThreshold) return;
+  
+  size_t capacity = 16;
+  while(capacity < entries.size() * 4) capacity *= 2;
+  
+  slots.resize(capacity, 0);
+  for(size_t i = 0; i < entries.size(); ++i) insertSlot(i);
+}
+
+void TagHash::insertSlot(size_t i) {
+  size_t mask = slots.size() - 1;
+  size_t s = entries[i].first.hash() & mask;
+  
+  // A later duplicate takes over the slot of the key it shadows.
+  while(slots[s] && entries[slots[s] - 1].first != entries[i].first) s = (s + 1) & mask;
+  slots[s] = (uint32_t)(i + 1);
 }
 
 #pragma mark - Value serialization
@@ -333,13 +800,27 @@ template<> void I64Array::deserialize(std::string str) {
 // (for example for arrays or 64bit integers)
 
 template<> std::string ByteArrayTag::serializeValue() const { return value.serialize(); }
-template<> void ByteArrayTag::deserializeValue(std::string str) { value.deserialize(str); }
+template<> void ByteArrayTag::deserializeValue(std::string str) { value.deserialize(str); markDirty(); }
 
 template<> std::string IntArrayTag::serializeValue() const { return value.serialize(); }
-template<> void IntArrayTag::deserializeValue(std::string str) { value.deserialize(str); }
+template<> void IntArrayTag::deserializeValue(std::string str) { value.deserialize(str); markDirty(); }
 
 template<> std::string LongArrayTag::serializeValue() const { return value.serialize(); }
-template<> void LongArrayTag::deserializeValue(std::string str) { value.deserialize(str); }
+template<> void LongArrayTag::deserializeValue(std::string str) { value.deserialize(str); markDirty(); }
 
-template<> std::string LongTag::serializeValue() const { return std::to_string(value); }
-template<> void LongTag::deserializeValue(std::string str) { value = std::stoll(str); }
\ No newline at end of file
+template<> std::string LongTag::serializeValue() const {
+  std::string out;
+  appendInteger(out, value);
+  return out;
+}
+
+template<> void LongTag::deserializeValue(std::string str) {
+  const char *begin = str.data(), *end = begin + str.length();
+  while(begin != end && *begin == ' ') ++begin;
+  while(end != begin && end[-1] == ' ') --end;
+  
+  int64_t parsed;
+  if(parseInteger(begin, end, parsed) != end) throw "Expected an integer.";
+  value = parsed;
+  markDirty();
+}
\ No newline at end of file
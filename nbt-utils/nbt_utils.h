@@ -13,10 +13,15 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <sstream>
-#include <iomanip>
 
 #include "endianness.h"
+#include "interned_name.h"
+#include "arena.h"
+#include "byte_reader.h"
+#include "byte_writer.h"
+#include "inflate_reader.h"
 #include "zlib_wrapper.h"
 
 namespace nbt {
@@ -48,72 +53,190 @@ namespace nbt {
     };
   };
   
+  //! How a document was encoded, as detected by Tag::load
+  struct DataFormat {
+    Compression::Enum compression;
+    bool withName; //!< Whether the root tag was named
+  };
+  
   class Tag;
   Tag *makeTag(TagType::Enum); //!< Factory method
+  std::shared_ptr<Tag> makeSharedTag(TagType::Enum, Arena *arena = NULL); //!< Factory method, optionally allocating from an arena
+  
+  Tag *copyTag(const Tag *tag); //!< Deep copy including the name, the copy has no parent
+  void copyValue(Tag *dst, const Tag *src); //!< Replaces the value of dst by a deep copy of that of src (which has to be of the same type)
+  
+  struct TagHash;
+  template<typename T> inline void adoptValue(T &, Tag *) {}
+  void adoptValue(TagHash &hash, Tag *owner); //!< Makes owner the parent of all entries
+  template<typename T> struct Array;
+  template<typename T> inline void adoptValue(Array<T> &array, Tag *owner) { array.owner = owner; }
   
   class Tag {
   public:
+    Tag() : hasName(false), startIndex(0), endIndex(0), parent(NULL), shift(0), headerSize(0), dirty(true), hashed(false), hash(0) {}
     virtual ~Tag() {}
 
-    std::string name;  //!< The name for this tag
+    Name name;         //!< The name for this tag
     bool hasName;      //!< Whether this tag was named
-    size_t startIndex, //!< The stream position this tag started on (set on read/write)
-           endIndex;   //!< The stream position this tag ended on (set on read/write)
+    size_t startIndex, //!< The stream position this tag started on (set on read/write, see getStartIndex)
+           endIndex;   //!< The stream position this tag ended on (set on read/write, see getEndIndex)
+    
+    Tag *parent;       //!< Compound or list this tag belongs to, NULL for the top of a tree
     
     // Emscripten interface
-    void setName(std::string name) { this->name = name; }
+    void setName(std::string name) { this->name = name; markDirty(); }
     std::string getName() const { return name; }
     
-    size_t getStartIndex() const { return startIndex; }
-    size_t getEndIndex() const { return endIndex; }
+    //! Position in the output of the last serialize(), clean subtrees copied by it are accounted for
+    size_t getStartIndex() const { return startIndex + accumulatedShift(); }
+    size_t getEndIndex() const { return endIndex + accumulatedShift(); }
     
-    void setHasName(bool hn) { hasName = hn; }
+    void setHasName(bool hn) { hasName = hn; markDirty(); }
     bool getHasName() const { return hasName; }
     
     virtual TagType::Enum tagType() const = 0;
     
+    //! Tags matching a path like "Level.Entities[*].Pos[1]", see Query (query.h), which also
+    //! avoids compiling the path again for every call
+    std::vector<Tag *> select(const std::string &path);
+    
+    // Change tracking
+    
+    //! Flags this tag and its ancestors as changed since they were last read or written, so the next
+    //! serialize() of the tree re-encodes them and their content hashes are computed again. Setters do
+    //! this by themselves, code that modifies value directly (or through getValuePtr) has to call it.
+    void markDirty() {
+      for(Tag *t = this; t && (!t->dirty || t->hashed); t = t->parent) {
+        t->dirty = true;
+        t->hashed = false;
+      }
+    }
+    void markSubtreeDirty(); //!< Has to be used for subtrees that are moved over from another tree
+    bool isDirty() const { return dirty; }
+    
+    //! Hash of the type and value (including everything below), see content_hash.h.
+    //! Computed on first use and cached until markDirty(), so unchanged subtrees are never hashed twice.
+    uint64_t contentHash() const;
+    bool hasContentHash() const { return hashed; } //!< Whether contentHash() is cached
+    
+    //! payloadSize() for dirty tags, clean ones know it from when they were last read or written
+    size_t encodedPayloadSize() const { return dirty ? payloadSize() : endIndex - startIndex - headerSize; }
+    
     // Read
+    static Tag *read(ByteReader &reader, bool withName = true, TagType::Enum type = TagType::Unknown);
+    static std::shared_ptr<Tag> readShared(ByteReader &reader, bool withName = true, TagType::Enum type = TagType::Unknown); //!< Allocates from reader.arena if set
+    static Tag *read(const uint8_t *data, size_t size, bool withName = true, TagType::Enum type = TagType::Unknown) {
+      ByteReader reader(data, size);
+      return read(reader, withName, type);
+    }
+    
+    //! Buffers the remainder of the stream and parses it in place, then seeks to the end of the tag
     static Tag *read(std::istream &stream, bool withName = true, TagType::Enum type = TagType::Unknown);
-    static Tag *deserialize(std::string input, bool withName = true, TagType::Enum type = TagType::Unknown) {
-      std::stringstream stream(input);
-      return read(stream, withName, type);
+    
+    static Tag *deserialize(const std::string &input, bool withName = true, TagType::Enum type = TagType::Unknown) {
+      return read((const uint8_t *)input.data(), input.length(), withName, type);
     }
     
-    static Tag *deserializeCompressed(std::string input, bool withName = true, TagType::Enum type = TagType::Unknown) {
-      std::stringstream stream(zlibInflate(input));
-      return read(stream, withName, type);
+    //! Decompresses while parsing, accepts both gzip and zlib streams
+    static Tag *deserializeCompressed(const std::string &input, bool withName = true, TagType::Enum type = TagType::Unknown) {
+      InflateReader reader((const uint8_t *)input.data(), input.length());
+      return read(reader, withName, type);
     }
     
+    //! Detects gzip/zlib/uncompressed input and whether the root tag is named, then parses it once.
+    //! @param format Receives what was detected, so the document can be saved the same way
+    //! @param lazyArrays Arrays borrow the (decompressed) input until they are modified, see ByteReader::lazyArrays
+    static Tag *load(const std::string &input, DataFormat *format = NULL, bool lazyArrays = false);
+    
+    // Skip
+    
+    //! Payload size for types whose encoding does not depend on their value, 0 for all others
+    static size_t fixedPayloadSize(TagType::Enum type);
+    
+    //! Advances past a tag without decoding it, fixed-size lists and arrays are skipped in one step
+    static void skip(ByteReader &reader, bool withName = true, TagType::Enum type = TagType::Unknown);
+    static void skipPayload(ByteReader &reader, TagType::Enum type);
+    static void skipEntries(ByteReader &reader, TagType::Enum entryKind, uint32_t count); //!< Skips the entries of a list
+    
+    //! Reads the entry type and count of a list payload.
+    //! Throws if a list of EndTags claims to have entries (they take no space, so 8 bytes would make billions).
+    static uint32_t readListHeader(ByteReader &reader, TagType::Enum &entryKind);
+    
     // Write
+    
+    //! The exact number of bytes Tag::write will produce for this tag
+    static size_t encodedSize(const Tag *tag, bool withName, TagType::Enum type = TagType::Unknown) {
+      return (type == TagType::Unknown ? 1 : 0) + (withName ? 2 + tag->name.length() : 0) + tag->encodedPayloadSize();
+    }
+    
+    static void write(Tag *tag, ByteWriter &writer, TagType::Enum type = TagType::Unknown);
+    static void write(Tag *tag, ByteWriter &writer, const std::string &name, TagType::Enum type = TagType::Unknown);
+    
+    //! Encodes into a temporary buffer first, startIndex/endIndex are relative to the stream's tellp()
     static void write(Tag *tag, std::ostream &stream, TagType::Enum type = TagType::Unknown);
     static void write(Tag *tag, std::ostream &stream, const std::string &name, TagType::Enum type = TagType::Unknown);
     
     // I am really not happy about this, but embind wants us to return std::basic_string<unsigned char> here,
     // because otherwise it will assume the output is UTF-8 encoded and mess up our data.
-    static std::basic_string<unsigned char> serialize(Tag *tag, TagType::Enum type = TagType::Unknown) {
-      std::stringstream stream;
-      if(tag->hasName) write(tag, stream, tag->name, type);
-      else write(tag, stream, type);
-      
-      auto c1 = stream.str();
-      return *(std::basic_string<unsigned char> *)&c1;
-    }
+    //! The top tag of a tree remembers its output, later calls only re-encode the dirty parts
+    //! and copy everything else over from the previous output.
+    static std::basic_string<unsigned char> serialize(Tag *tag, TagType::Enum type = TagType::Unknown) { return *serializeShared(tag, type); }
+    
+    //! Same as serialize, but hands out the buffer the top tag keeps instead of a copy of it.
+    //! The buffer stays valid (and unchanged) after later calls, those encode into a new one.
+    static std::shared_ptr<const std::basic_string<unsigned char>> serializeShared(Tag *tag, TagType::Enum type = TagType::Unknown);
     
     static std::basic_string<unsigned char> serializeCompressed(Tag *tag, TagType::Enum type = TagType::Unknown) {
-      auto c1 = serialize(tag, type);
-      auto c2 = zlibDeflate(*(std::string *)&c1);
+      return save(tag, Compression::Gzip, type);
+    }
+    
+    //! Serializes and compresses in the given format (e.g. the one reported by Tag::load)
+    static std::basic_string<unsigned char> save(Tag *tag, Compression::Enum compression, TagType::Enum type = TagType::Unknown) {
+      return save(tag, DeflateOptions(compression), type);
+    }
+    
+    //! Serializes and compresses with the given level, framing and (optionally) in parallel
+    static std::basic_string<unsigned char> save(Tag *tag, const DeflateOptions &options, TagType::Enum type = TagType::Unknown) {
+      auto c1 = serializeShared(tag, type);
+      if(options.format == Compression::None) return *c1;
+      
+      auto c2 = zlibDeflate(*(const std::string *)c1.get(), options);
       return *(std::basic_string<unsigned char> *)&c2;
     }
     
-    virtual void readPayload(std::istream &stream) = 0;
-    virtual void writePayload(std::ostream &stream) const = 0;
+    virtual void readPayload(ByteReader &reader) = 0;
+    virtual void writePayload(ByteWriter &writer) const = 0;
+    virtual size_t payloadSize() const = 0;
+    
+  protected:
+    //! Writes a child, clean subtrees are copied from writer.previous if there is one
+    static void writeTag(Tag *tag, ByteWriter &writer, const std::string *name, TagType::Enum type);
+    
+  private:
+    Tag(const Tag &);
+    Tag &operator=(const Tag &);
+    
+    static TagType::Enum readHeader(ByteReader &reader, bool withName, TagType::Enum type, Name &name);
+    void readBody(ByteReader &reader, Name &name, bool withName, size_t startIndex);
+    
+    ptrdiff_t accumulatedShift() const;
+    void dropEncoding(); //!< Forgets the output cached by the top of the tree
+    
+    ptrdiff_t shift;     //!< How far this subtree moved in the output since its indices were set, see writeTag
+    uint32_t headerSize; //!< Type and name bytes in front of the payload
+    bool dirty;          //!< Changed since the last read/write, the indices are stale
+    mutable bool hashed; //!< hash is up to date (then it is for all descendants as well)
+    mutable uint64_t hash;
+    std::shared_ptr<const std::basic_string<unsigned char>> encoding; //!< Last serialize() output (top of a tree only)
   };
   
   class EndTag : public Tag {
   public:
     virtual TagType::Enum tagType() const { return TagType::End; }
-    virtual void readPayload(std::istream &stream) {}
-    virtual void writePayload(std::ostream &stream) const {}
+    virtual void readPayload(ByteReader &reader) {}
+    virtual void writePayload(ByteWriter &writer) const {}
+    virtual size_t payloadSize() const { return 0; }
   };
   
   template<typename T, TagType::Enum type>
@@ -124,20 +247,24 @@ namespace nbt {
     T getValue() { return value; }
     T *getValuePtr() { return &value; }
     
-    void setValue(const T value) { this->value = value; }
+    void setValue(const T value) {
+      this->value = value;
+      adoptValue(this->value, this);
+      markDirty();
+    }
     
     virtual std::string serializeValue() const;
     virtual void deserializeValue(std::string str);
     
-    PrimitiveTag<T>() {}
+    PrimitiveTag() { adoptValue(value, this); }
     
-    PrimitiveTag<T>(const T &value) : value(value) {}
-    PrimitiveTag<T>(const T  value) : value(value) {}
+    PrimitiveTag(const T &value) : value(value) { adoptValue(this->value, this); }
     
     virtual TagType::Enum tagType() const { return type; }
     
-    virtual void readPayload(std::istream &stream);
-    virtual void writePayload(std::ostream &stream) const;
+    virtual void readPayload(ByteReader &reader);
+    virtual void writePayload(ByteWriter &writer) const;
+    virtual size_t payloadSize() const;
   };
   
   typedef PrimitiveTag<std::vector<std::shared_ptr<Tag>>, TagType::List> ListTagBase;
@@ -145,25 +272,28 @@ namespace nbt {
   class ListTag : public ListTagBase {
   public:
     TagType::Enum entryKind;
-    static void read(std::istream &stream, ListTag &tag);
+    virtual void readPayload(ByteReader &reader);
+    virtual void writePayload(ByteWriter &writer) const;
+    virtual size_t payloadSize() const;
     
-    virtual void readPayload(std::istream &stream);
-    virtual void writePayload(std::ostream &stream) const;
+    virtual ~ListTag();
     
     // Emscripten interface
     TagType::Enum getEntryKind() const { return entryKind; }
-    void setEntryKind(TagType::Enum k) { entryKind = k; }
+    void setEntryKind(TagType::Enum k) { entryKind = k; markDirty(); }
     
-    void clear() { value.clear(); }
+    void clear();
     
     Tag *getElement(size_t i) { return value[i].get(); }
     Tag *addElement() {
       Tag *t = makeTag(entryKind);
+      t->parent = this;
       value.push_back(std::shared_ptr<Tag>(t));
+      markDirty();
       return t;
     }
     
-    void removeElement(size_t i) { value.erase(value.begin()+i); }
+    void removeElement(size_t i);
     
     size_t getCount() { return value.size(); }
   };
@@ -175,19 +305,93 @@ namespace nbt {
     std::shared_ptr<T> data;
     size_t count = 0;
     
+    bool wireOrder = false; //!< data holds big-endian values (read with ByteReader::lazyArrays)
+    bool borrowed = false;  //!< data points into the input buffer and must not be written to
+    
+    Tag *owner = NULL; //!< The tag this is the value of, which is marked dirty on changes
+    
+    Array() {}
+    Array(const Array &other) : data(other.data), count(other.count), wireOrder(other.wireOrder), borrowed(other.borrowed) {} //!< The copy has no owner
+    Array &operator=(const Array &other) {
+      data = other.data;
+      count = other.count;
+      wireOrder = other.wireOrder;
+      borrowed = other.borrowed;
+      return *this;
+    }
+    
     // Emscripten interface
     
-    T getElement(size_t i) const { return data.get()[i]; }
-    void setElement(size_t i, T value) { data.get()[i] = value; }
+    T getElement(size_t i) const {
+      if(!wireOrder) return data.get()[i];
+      
+      T value;
+      convertOrder(&value, data.get() + i, 1);
+      return value;
+    }
+    
+    void setElement(size_t i, T value) { mutate()[i] = value; }
     
     std::string serialize() const;
     void deserialize(std::string value);
     
     size_t getCount() const { return count; }
     void resize(size_t count) {
-      T *newData = (T *)malloc(sizeof(T) * count);
-      this->data.reset(newData);
+      allocate(count);
+      markDirty();
+    }
+    
+    //! Replaces the contents with count uninitialized elements. Doesn't mark the owner dirty,
+    //! as this is also how payloads are read, callers that change a tree have to do that.
+    void allocate(size_t count, Arena *arena = NULL) {
+      if(arena) {
+        T *newData = (T *)arena->allocate(sizeof(T) * count);
+        this->data = std::shared_ptr<T>(newData, ArenaDeleter(), ArenaAllocator<T>(arena));
+      } else
+        this->data = std::shared_ptr<T>((T *)malloc(sizeof(T) * count), free);
       this->count = count;
+      this->wireOrder = this->borrowed = false;
+    }
+    
+    //! Host-order elements that may be written to and marks the owner dirty. A lazily read payload
+    //! is converted (and copied out of the input buffer, if it was borrowed) on first use.
+    //! The pointer is only valid until the array is resized or replaced, or until it is copied (copyValue,
+    //! setValue): the payload is shared with the copy then, and the next mutate() or ownData() moves this
+    //! array to a buffer of its own, so writes through the old pointer would change the copy instead.
+    T *mutate() {
+      T *elements = ownData();
+      markDirty();
+      return elements;
+    }
+    
+    //! Same as mutate(), but without marking the owner dirty, so writes through the pointer have to be followed by markDirty()
+    T *ownData() {
+      // Payloads shared with copies of this array are copied first, so the copies keep their values.
+      if(borrowed || (data && data.use_count() > 1)) {
+        std::shared_ptr<T> source = data;
+        bool swap = wireOrder;
+        
+        allocate(count);
+        if(swap) convertOrder(data.get(), source.get(), count);
+        else if(count) memcpy(data.get(), source.get(), count * sizeof(T));
+      } else if(wireOrder) {
+        convertOrder(data.get(), data.get(), count);
+        wireOrder = false;
+      }
+      
+      return data.get();
+    }
+    
+    void markDirty() { if(owner) owner->markDirty(); }
+    
+    //! Swaps between big-endian and host order, dst may be src
+    static void convertOrder(T *dst, const T *src, size_t count) {
+      switch(sizeof(T)) {
+        case 2: swapCopy16(dst, src, count); break;
+        case 4: swapCopy32(dst, src, count); break;
+        case 8: swapCopy64(dst, src, count); break;
+        default: if(dst != src) memcpy(dst, src, count * sizeof(T));
+      }
     }
   };
   
@@ -197,28 +401,80 @@ namespace nbt {
   
 #pragma mark - Hash
   
-  typedef std::map<std::string, std::shared_ptr<Tag>> TagHashBase;
-  struct TagHash : public TagHashBase {
-    // Emscripten interface
+  //! Compound storage: entries stay in insertion order, so writing reproduces the original layout,
+  //! and are keyed by interned names. Small compounds are searched linearly, larger ones
+  //! additionally get an open-addressing index into the entries.
+  //! Keys can occur more than once (files in the wild do that), lookups then see the last entry,
+  //! just like the game, which keeps overwriting the same key while reading.
+  struct TagHash {
+    struct Entry {
+      Name first;                  //!< Key
+      std::shared_ptr<Tag> second; //!< Value
+    };
     
-    typename TagHashBase::iterator jsIterator;
+    typedef std::vector<Entry>::iterator iterator;
+    typedef std::vector<Entry>::const_iterator const_iterator;
     
-    void jsBegin() { jsIterator = begin(); }
-    bool jsAtEnd() { return jsIterator == end(); }
-    void jsNext() { ++jsIterator; }
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
     
-    std::string getName() { return jsIterator->first; }
-    Tag *getTag() { return jsIterator->second.get(); }
+    TagHash() {}
+    TagHash(const TagHash &other) : entries(other.entries), slots(other.slots) {} //!< The copy has no owner
+    TagHash &operator=(const TagHash &other) { entries = other.entries; slots = other.slots; return *this; }
+    ~TagHash();
     
-    void jsRename(std::string oldKey, std::string newKey) {
-      std::shared_ptr<Tag> tag = (*this)[oldKey];
-      erase(oldKey);
-      
-      (*this)[newKey] = tag;
-    }
+    Tag *owner = NULL; //!< The compound this belongs to, which is marked dirty on changes
+    
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void clear();
+    
+    iterator find(const Name &key) { return at(indexOf(key)); }
+    iterator find(const std::string &key) { return at(indexOf(key)); } //!< Doesn't intern the key
+    const_iterator find(const Name &key) const { return at(indexOf(key)); }
+    const_iterator find(const std::string &key) const { return at(indexOf(key)); }
     
+    //! The value for key, a new (empty) entry is appended if there is none.
+    //! Marks the owner dirty, but tags assigned through the reference don't get their parent set.
+    std::shared_ptr<Tag> &operator[](const Name &key);
+    
+    //! Appends an entry even if the key exists already, it then shadows the earlier ones
+    void append(const Name &key, const std::shared_ptr<Tag> &tag);
+    
+    iterator erase(iterator it);
+    size_t erase(const std::string &key); //!< Removes all entries with that key
+    
+    // Emscripten interface
+    
+    size_t jsIndex = 0;
+    
+    void jsBegin() { jsIndex = 0; }
+    bool jsAtEnd() { return jsIndex >= entries.size(); }
+    void jsNext() { ++jsIndex; }
+    
+    std::string getName() { return entries[jsIndex].first; }
+    Tag *getTag() { return entries[jsIndex].second.get(); }
+    
+    void jsRename(std::string oldKey, std::string newKey); //!< Keeps the entry's position, replaces entries with newKey
     void jsRemove(std::string key) { erase(key); }
-    void jsSet(std::string key, Tag *tag) { (*this)[key] = std::shared_ptr<Tag>(tag); }
+    void jsSet(std::string key, Tag *tag);
+    
+  private:
+    static const size_t npos = (size_t)-1;
+    static const size_t IndexThreshold = 8; //!< Compounds up to this size are searched linearly
+    
+    size_t indexOf(const Name &key) const;
+    size_t indexOf(const std::string &key) const;
+    iterator at(size_t i) { return i == npos ? end() : begin() + i; }
+    const_iterator at(size_t i) const { return i == npos ? end() : begin() + i; }
+    
+    void rebuildIndex();
+    void insertSlot(size_t i);
+    
+    std::vector<Entry> entries;
+    std::vector<uint32_t> slots; //!< Entry index + 1 (0 is empty), a power of two in size, empty while unindexed
   };
   
 #pragma mark - Typedefs
@@ -235,6 +491,35 @@ namespace nbt {
   typedef PrimitiveTag<I32Array    , TagType::IntArray  > IntArrayTag;
   typedef PrimitiveTag<I64Array    , TagType::LongArray > LongArrayTag;
   
+#pragma mark - Document
+  
+  //! Owns a tree whose tags and array payloads are allocated from a single arena,
+  //! so parsing and teardown cost a handful of large allocations instead of one per tag.
+  //! Container storage, strings and names still come from the heap, see Arena for the full list.
+  //! Tags belonging to a document must not outlive it.
+  class Document {
+  public:
+    explicit Document(size_t blockSize = 64 << 10) : arena(blockSize) {}
+    ~Document() { root.reset(); } // Run the tag destructors before the arena goes away
+    
+    Tag *parse(const uint8_t *data, size_t size, bool withName = true, TagType::Enum type = TagType::Unknown) {
+      ByteReader reader(data, size);
+      reader.arena = &arena;
+      root = Tag::readShared(reader, withName, type);
+      return root.get();
+    }
+    
+    Tag *getRoot() const { return root.get(); }
+    const Arena &getArena() const { return arena; }
+    
+  private:
+    Document(const Document &);
+    Document &operator=(const Document &);
+    
+    Arena arena;
+    std::shared_ptr<Tag> root;
+  };
+  
 #pragma mark - Value serialization
   // (emscripten)
   // These are used to interface with JavaScript in cases
@@ -0,0 +1,162 @@
+//
+//  packed_indices.cpp
+//  nbt-utils
+//
+
+#include "packed_indices.h"
+
+#include <algorithm>
+
+using namespace nbt;
+
+#pragma mark - Kernels
+
+// Aligned: each long holds 64 / Bits entries starting at bit 0.
+// Spanning: 64 entries take up exactly Bits longs, so the bit offsets repeat with that period and
+// whole groups can be handled with offsets known at compile time; only the last partial group isn't.
+
+template<unsigned Bits> static void unpackAligned(const uint64_t *words, uint16_t *indices, size_t count) {
+  const unsigned perWord = 64 / Bits;
+  const uint64_t mask = (1ull << Bits) - 1;
+  
+  size_t full = count / perWord;
+  for(size_t w = 0; w < full; ++w, indices += perWord) {
+    uint64_t word = words[w];
+    for(unsigned j = 0; j < perWord; ++j) indices[j] = (uint16_t)((word >> (j * Bits)) & mask);
+  }
+  
+  size_t rest = count - full * perWord;
+  for(unsigned j = 0; j < rest; ++j) indices[j] = (uint16_t)((words[full] >> (j * Bits)) & mask);
+}
+
+template<unsigned Bits> static void packAligned(const uint16_t *indices, size_t count, uint64_t *words) {
+  const unsigned perWord = 64 / Bits;
+  const uint64_t mask = (1ull << Bits) - 1;
+  
+  size_t full = count / perWord;
+  for(size_t w = 0; w < full; ++w, indices += perWord) {
+    uint64_t word = 0;
+    for(unsigned j = 0; j < perWord; ++j) word |= (indices[j] & mask) << (j * Bits);
+    words[w] = word;
+  }
+  
+  size_t rest = count - full * perWord;
+  if(rest) {
+    uint64_t word = 0;
+    for(unsigned j = 0; j < rest; ++j) word |= (indices[j] & mask) << (j * Bits);
+    words[full] = word;
+  }
+}
+
+template<unsigned Bits> static inline uint16_t extract(const uint64_t *words, size_t bit) {
+  const uint64_t mask = (1ull << Bits) - 1;
+  
+  size_t w = bit >> 6;
+  unsigned offset = bit & 63;
+  
+  uint64_t value = words[w] >> offset;
+  if(offset + Bits > 64) value |= words[w + 1] << (64 - offset);
+  return (uint16_t)(value & mask);
+}
+
+template<unsigned Bits> static inline void insert(uint64_t *words, size_t bit, uint16_t index) {
+  const uint64_t value = index & ((1ull << Bits) - 1);
+  
+  size_t w = bit >> 6;
+  unsigned offset = bit & 63;
+  
+  words[w] |= value << offset;
+  if(offset + Bits > 64) words[w + 1] |= value >> (64 - offset);
+}
+
+template<unsigned Bits> static void unpackSpanning(const uint64_t *words, uint16_t *indices, size_t count) {
+  size_t groups = count / 64;
+  for(size_t g = 0; g < groups; ++g, words += Bits, indices += 64)
+    for(unsigned j = 0; j < 64; ++j) indices[j] = extract<Bits>(words, j * Bits);
+    
+  for(unsigned j = 0; j < count % 64; ++j) indices[j] = extract<Bits>(words, j * Bits);
+}
+
+template<unsigned Bits> static void packSpanning(const uint16_t *indices, size_t count, uint64_t *words) {
+  std::fill(words, words + packedLength(count, Bits, PackedLayout::Spanning), 0);
+  
+  size_t groups = count / 64;
+  for(size_t g = 0; g < groups; ++g, words += Bits, indices += 64)
+    for(unsigned j = 0; j < 64; ++j) insert<Bits>(words, j * Bits, indices[j]);
+    
+  for(unsigned j = 0; j < count % 64; ++j) insert<Bits>(words, j * Bits, indices[j]);
+}
+
+typedef void (*UnpackKernel)(const uint64_t *words, uint16_t *indices, size_t count);
+typedef void (*PackKernel)(const uint16_t *indices, size_t count, uint64_t *words);
+
+#define by_width(kernel) { NULL, \
+  kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7>, kernel<8>, \
+  kernel<9>, kernel<10>, kernel<11>, kernel<12>, kernel<13>, kernel<14>, kernel<15>, kernel<16> }
+  
+static const UnpackKernel unpackKernels[2][17] = { by_width(unpackSpanning), by_width(unpackAligned) };
+static const PackKernel packKernels[2][17] = { by_width(packSpanning), by_width(packAligned) };
+
+#undef by_width
+
+#pragma mark - Interface
+
+size_t nbt::packedLength(size_t count, unsigned bits, PackedLayout::Enum layout) {
+  if(bits == 0) return 0;
+  if(layout == PackedLayout::Aligned) {
+    size_t perWord = 64 / bits;
+    return (count + perWord - 1) / perWord;
+  }
+  return (count * bits + 63) / 64;
+}
+
+unsigned nbt::bitsForPalette(size_t paletteSize, unsigned minBits) {
+  unsigned bits = 0;
+  while(((size_t)1 << bits) < paletteSize) ++bits;
+  return bits > minBits ? bits : minBits;
+}
+
+void nbt::unpackIndices(const uint64_t *words, size_t wordCount, unsigned bits, PackedLayout::Enum layout, uint16_t *indices, size_t count) {
+  if(bits > 16) throw "Packed indices can have at most 16 bits.";
+  if(wordCount < packedLength(count, bits, layout)) throw "Packed array is too short for its entries.";
+  
+  if(bits == 0) std::fill(indices, indices + count, 0);
+  else unpackKernels[layout == PackedLayout::Aligned][bits](words, indices, count);
+}
+
+void nbt::packIndices(const uint16_t *indices, size_t count, unsigned bits, PackedLayout::Enum layout, uint64_t *words) {
+  if(bits > 16) throw "Packed indices can have at most 16 bits.";
+  if(bits > 0) packKernels[layout == PackedLayout::Aligned][bits](indices, count, words);
+}
+
+std::vector<uint16_t> nbt::unpackIndices(const I64Array &array, size_t count, unsigned bits, PackedLayout::Enum layout) {
+  std::vector<uint16_t> indices(count);
+  const uint64_t *words = (const uint64_t *)array.data.get();
+  
+  std::vector<int64_t> converted;
+  if(array.wireOrder) {
+    converted.resize(array.count);
+    I64Array::convertOrder(converted.data(), array.data.get(), array.count);
+    words = (const uint64_t *)converted.data();
+  }
+  
+  unpackIndices(words, array.count, bits, layout, indices.data(), count);
+  return indices;
+}
+
+void nbt::packIndices(LongArrayTag *tag, const uint16_t *indices, size_t count, unsigned bits, PackedLayout::Enum layout) {
+  if(bits > 16) throw "Packed indices can have at most 16 bits.";
+  
+  tag->value.allocate(packedLength(count, bits, layout));
+  packIndices(indices, count, bits, layout, (uint64_t *)tag->value.data.get());
+  tag->markDirty();
+}
+
+void nbt::countIndices(const uint16_t *indices, size_t count, uint32_t *counts, size_t paletteSize) {
+  for(size_t i = 0; i < count; ++i)
+    if(indices[i] < paletteSize) ++counts[indices[i]];
+}
+
+void nbt::remapIndices(uint16_t *indices, size_t count, const uint16_t *mapping) {
+  for(size_t i = 0; i < count; ++i) indices[i] = mapping[indices[i]];
+}
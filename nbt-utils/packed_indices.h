@@ -0,0 +1,65 @@
+//
+//  packed_indices.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__packed_indices__
+#define __nbt_utils__packed_indices__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "nbt_utils.h"
+
+// Chunk sections store block states (and, since 1.18, biomes) as palette indices of a fixed
+// number of bits packed into the longs of a LongArray. These convert between that and plain
+// uint16_t indices for a whole array at a time. Every width from 1 to 16 bits has its own
+// instantiation of the kernels, so shifts and masks are constants the compiler can unroll and vectorize.
+
+namespace nbt {
+  struct PackedLayout {
+#ifdef EMSCRIPTEN
+    // (emscripten)
+    // Using chars instead of an enum-values makes bindings easier.
+    
+    typedef char Enum;
+    enum Values : char {
+#else
+    enum Enum : char {
+#endif
+      Spanning = 0, //!< Before 1.16: entries follow each other bit by bit and may straddle two longs
+      Aligned  = 1  //!< 1.16 and later: as many whole entries per long as fit, the top bits stay unused
+    };
+  };
+  
+  //! Number of longs that count entries of the given width take up
+  size_t packedLength(size_t count, unsigned bits, PackedLayout::Enum layout);
+  
+  //! Smallest width that can address paletteSize entries, but at least minBits
+  //! (the game uses at least 4 bits for block states and 1 for biomes)
+  unsigned bitsForPalette(size_t paletteSize, unsigned minBits = 4);
+  
+  //! Extracts count indices of bits bits (0 to 16, 0 meaning all indices are 0) from host-order words.
+  //! Throws if wordCount is less than packedLength().
+  void unpackIndices(const uint64_t *words, size_t wordCount, unsigned bits, PackedLayout::Enum layout, uint16_t *indices, size_t count);
+  
+  //! Inverse of unpackIndices, words has to have room for packedLength() longs. Indices are
+  //! truncated to bits bits, unused bits end up as 0.
+  void packIndices(const uint16_t *indices, size_t count, unsigned bits, PackedLayout::Enum layout, uint64_t *words);
+  
+  //! Unpacks a LongArray (e.g. "BlockStates" or "data"), lazily read arrays are converted on the fly
+  std::vector<uint16_t> unpackIndices(const I64Array &array, size_t count, unsigned bits, PackedLayout::Enum layout);
+  
+  //! Replaces the contents of the tag with the packed indices and marks it dirty
+  void packIndices(LongArrayTag *tag, const uint16_t *indices, size_t count, unsigned bits, PackedLayout::Enum layout);
+  
+  //! Adds the number of occurrences of every palette index to counts[index], indices >= paletteSize are ignored
+  void countIndices(const uint16_t *indices, size_t count, uint32_t *counts, size_t paletteSize);
+  
+  //! Replaces every index with mapping[index], e.g. to swap blocks or to compact a palette.
+  //! mapping needs an entry for every index that occurs.
+  void remapIndices(uint16_t *indices, size_t count, const uint16_t *mapping);
+}
+
+#endif /* defined(__nbt_utils__packed_indices__) */
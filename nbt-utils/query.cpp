@@ -0,0 +1,519 @@
+//
+//  query.cpp
+//  nbt-utils
+//
+
+#include "query.h"
+#include "snbt.h"
+
+#include <stdlib.h>
+
+using namespace nbt;
+
+std::vector<Tag *> Tag::select(const std::string &path) {
+  return Query(path).select(this);
+}
+
+#pragma mark - Parser
+
+class Query::Parser {
+public:
+  Parser(const std::string &text) : p(text.data()), end(text.data() + text.length()) {}
+  
+  void parse(std::vector<Step> &steps) {
+    skipSpace();
+    if(p == end) return; // The empty path selects the root itself
+    
+    if(*p == '[') parseBracket(steps);
+    else if(*p == '{') parseFilter(steps);
+    else parseKey(steps);
+    
+    for(;;) {
+      skipSpace();
+      if(p == end) return;
+      
+      switch(*p) {
+        case '.': ++p; skipSpace(); parseKey(steps); break;
+        case '[': parseBracket(steps); break;
+        case '{': parseFilter(steps); break;
+        default: throw "Invalid query: expected '.', '[' or '{'.";
+      }
+    }
+  }
+  
+private:
+  const char *p, *end;
+  
+  void skipSpace() { while(p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p; }
+  
+  void expect(char c, const char *error) {
+    skipSpace();
+    if(p == end || *p != c) throw error;
+    ++p;
+  }
+  
+  //! Characters that end an unquoted key or value. Inside predicates that's ':' and ',' instead of '.'
+  static bool isDelimiter(char c, bool inPattern) {
+    switch(c) {
+      case ' ': case '\t': case '\n': case '\r':
+      case '[': case ']': case '{': case '}': case '"': case '\'':
+        return true;
+      case '.':
+        return !inPattern;
+      case ':': case ',':
+        return inPattern;
+      default:
+        return false;
+    }
+  }
+  
+  std::string parseQuoted() {
+    char quote = *p++;
+    std::string str;
+    
+    for(;;) {
+      if(p == end) throw "Invalid query: unterminated string.";
+      char c = *p++;
+      if(c == quote) return str;
+      if(c == '\\') {
+        if(p == end) throw "Invalid query: unterminated string.";
+        c = *p++;
+      }
+      str += c;
+    }
+  }
+  
+  std::string parseWord(bool inPattern) {
+    if(p != end && (*p == '"' || *p == '\'')) return parseQuoted();
+    
+    const char *start = p;
+    while(p != end && !isDelimiter(*p, inPattern)) ++p;
+    if(p == start) throw "Invalid query: expected a key.";
+    return std::string(start, p);
+  }
+  
+  void parseKey(std::vector<Step> &steps) {
+    Step step;
+    bool quoted = p != end && (*p == '"' || *p == '\'');
+    std::string key = parseWord(false);
+    
+    step.kind = key == "*" && !quoted ? Step::AnyKey : Step::Key;
+    step.key = key;
+    steps.push_back(step);
+  }
+  
+  void parseBracket(std::vector<Step> &steps) {
+    ++p; // [
+    skipSpace();
+    
+    Step step;
+    step.kind = Step::AllEntries;
+    
+    if(p != end && *p == '*') ++p;
+    else if(p != end && *p == '{') {
+      steps.push_back(step);
+      parseFilter(steps);
+      expect(']', "Invalid query: expected ']'.");
+      return;
+    } else if(p != end && *p != ']') {
+      std::string rest(p, end); // strtoll needs a terminator
+      char *numberEnd;
+      long long index = strtoll(rest.c_str(), &numberEnd, 10);
+      if(numberEnd == rest.c_str()) throw "Invalid query: expected an index, '*' or a predicate.";
+      p += numberEnd - rest.c_str();
+      
+      step.kind = Step::Index;
+      step.index = index;
+    }
+    
+    expect(']', "Invalid query: expected ']'.");
+    steps.push_back(step);
+  }
+  
+  void parseFilter(std::vector<Step> &steps) {
+    Step step;
+    step.kind = Step::Filter;
+    step.pattern = parsePattern();
+    steps.push_back(step);
+  }
+  
+  std::shared_ptr<Pattern> parsePattern() {
+    ++p; // {
+    std::shared_ptr<Pattern> pattern(new Pattern());
+    
+    skipSpace();
+    if(p != end && *p == '}') {
+      ++p;
+      return pattern;
+    }
+    
+    for(;;) {
+      skipSpace();
+      std::string key = parseWord(true);
+      expect(':', "Invalid query: expected ':' after a predicate key.");
+      skipSpace();
+      pattern->fields.push_back(std::make_pair(key, parseValue()));
+      
+      skipSpace();
+      if(p == end) throw "Invalid query: unterminated predicate.";
+      if(*p == '}') break;
+      expect(',', "Invalid query: expected ',' or '}' in a predicate.");
+    }
+    
+    ++p; // }
+    return pattern;
+  }
+  
+  Value parseValue() {
+    Value value;
+    value.type = TagType::Unknown;
+    value.integer = 0;
+    value.real = 0;
+    
+    if(p == end) throw "Invalid query: expected a value.";
+    if(*p == '[') throw "Invalid query: lists are not supported in predicates.";
+    
+    if(*p == '{') {
+      value.kind = Value::Compound;
+      value.type = TagType::Compound;
+      value.compound = parsePattern();
+      return value;
+    }
+    
+    bool quoted = *p == '"' || *p == '\'';
+    value.kind = Value::String;
+    value.string = parseWord(true);
+    if(quoted) {
+      value.type = TagType::String;
+      return value;
+    }
+    
+    if(value.string == "true" || value.string == "false") {
+      value.kind = Value::Integer;
+      value.type = TagType::Byte;
+      value.integer = value.string == "true";
+      return value;
+    }
+    
+    parseNumber(value);
+    return value;
+  }
+  
+  //! Turns a bare word into a number if it is one (like 12, -3b, 1.5f or 2e3), leaves it a string otherwise
+  static void parseNumber(Value &value) {
+    std::string text = value.string;
+    TagType::Enum type = TagType::Unknown;
+    
+    switch(text.empty() ? 0 : text[text.length() - 1]) {
+      case 'b': case 'B': type = TagType::Byte; break;
+      case 's': case 'S': type = TagType::Short; break;
+      case 'l': case 'L': type = TagType::Long; break;
+      case 'f': case 'F': type = TagType::Float; break;
+      case 'd': case 'D': type = TagType::Double; break;
+    }
+    if(type != TagType::Unknown) text.erase(text.length() - 1);
+    if(text.empty()) return;
+    
+    const char *start = text.c_str();
+    char *numberEnd;
+    
+    bool real = type == TagType::Float || type == TagType::Double || text.find_first_of(".eE") != std::string::npos;
+    if(real) {
+      double number;
+      if(parseReal(start, start + text.length(), number) != start + text.length()) return;
+      
+      value.kind = Value::Real;
+      value.real = number;
+    } else {
+      long long number = strtoll(start, &numberEnd, 10);
+      if(*numberEnd) return;
+      
+      value.kind = Value::Integer;
+      value.integer = number;
+    }
+    
+    value.type = type;
+    value.string.clear();
+  }
+};
+
+Query::Query(const std::string &path) : path(path) {
+  Parser(path).parse(steps);
+}
+
+#pragma mark - Trees
+
+std::vector<Tag *> Query::select(Tag *root) const {
+  std::vector<Tag *> out;
+  selectFrom(root, 0, out, false);
+  return out;
+}
+
+Tag *Query::first(Tag *root) const {
+  std::vector<Tag *> out;
+  selectFrom(root, 0, out, true);
+  return out.empty() ? NULL : out[0];
+}
+
+void Query::selectFrom(Tag *tag, size_t i, std::vector<Tag *> &out, bool firstOnly) const {
+  if(firstOnly && !out.empty()) return;
+  if(i == steps.size()) {
+    out.push_back(tag);
+    return;
+  }
+  
+  const Step &step = steps[i];
+  TagType::Enum type = tag->tagType();
+  
+  switch(step.kind) {
+    case Step::Key: {
+      if(type != TagType::Compound) return;
+      
+      TagHash &hash = ((CompoundTag *)tag)->value;
+      TagHash::iterator it = hash.find(step.key);
+      if(it != hash.end()) selectFrom(it->second.get(), i + 1, out, firstOnly);
+      return;
+    }
+    
+    case Step::AnyKey: {
+      if(type != TagType::Compound) return;
+      
+      TagHash &hash = ((CompoundTag *)tag)->value;
+      for(TagHash::iterator it = hash.begin(); it != hash.end(); ++it)
+        if(hash.find(it->first) == it) // Entries shadowed by a later one with the same key don't count
+          selectFrom(it->second.get(), i + 1, out, firstOnly);
+      return;
+    }
+    
+    case Step::Index: {
+      if(type != TagType::List) return;
+      
+      std::vector<std::shared_ptr<Tag>> &entries = ((ListTag *)tag)->value;
+      int64_t index = step.index < 0 ? step.index + (int64_t)entries.size() : step.index;
+      if(index >= 0 && index < (int64_t)entries.size()) selectFrom(entries[index].get(), i + 1, out, firstOnly);
+      return;
+    }
+    
+    case Step::AllEntries: {
+      if(type != TagType::List) return;
+      
+      std::vector<std::shared_ptr<Tag>> &entries = ((ListTag *)tag)->value;
+      for(size_t j = 0; j < entries.size(); ++j) selectFrom(entries[j].get(), i + 1, out, firstOnly);
+      return;
+    }
+    
+    case Step::Filter:
+      if(matches(tag, *step.pattern)) selectFrom(tag, i + 1, out, firstOnly);
+      return;
+  }
+}
+
+bool Query::matches(const Tag *tag, const Pattern &pattern) {
+  if(tag->tagType() != TagType::Compound) return false;
+  const TagHash &hash = ((const CompoundTag *)tag)->value;
+  
+  for(size_t i = 0; i < pattern.fields.size(); ++i) {
+    TagHash::const_iterator it = hash.find(pattern.fields[i].first);
+    if(it == hash.end() || !matches(it->second.get(), pattern.fields[i].second)) return false;
+  }
+  
+  return true;
+}
+
+bool Query::matches(const Tag *tag, const Value &value) {
+  TagType::Enum type = tag->tagType();
+  if(value.type != TagType::Unknown && value.type != type) return false;
+  
+  Scalar scalar;
+  scalar.type = type;
+  
+  switch(type) {
+    case TagType::Byte: scalar.integer = ((const ByteTag *)tag)->value; break;
+    case TagType::Short: scalar.integer = ((const ShortTag *)tag)->value; break;
+    case TagType::Int: scalar.integer = ((const IntTag *)tag)->value; break;
+    case TagType::Long: scalar.integer = ((const LongTag *)tag)->value; break;
+    case TagType::Float: scalar.real = ((const FloatTag *)tag)->value; break;
+    case TagType::Double: scalar.real = ((const DoubleTag *)tag)->value; break;
+    case TagType::String: return value.kind == Value::String && ((const StringTag *)tag)->value == value.string;
+    case TagType::Compound: return value.kind == Value::Compound && matches(tag, *value.compound);
+    default: return false;
+  }
+  
+  return matchesScalar(scalar, value);
+}
+
+bool Query::matchesScalar(const Scalar &scalar, const Value &value) {
+  bool integral = scalar.type != TagType::Float && scalar.type != TagType::Double;
+  
+  switch(value.kind) {
+    case Value::Integer: return integral ? scalar.integer == value.integer : scalar.real == (double)value.integer;
+    case Value::Real:
+      if(integral) return (double)scalar.integer == value.real;
+      if(scalar.type == TagType::Float) return (float)scalar.real == (float)value.real; // 0.1f is not 0.1
+      return scalar.real == value.real;
+    default: return false;
+  }
+}
+
+#pragma mark - Encoded documents
+
+size_t Query::scan(const uint8_t *data, size_t size, std::vector<RawMatch> &out, bool withName) const {
+  size_t count = out.size();
+  
+  ByteReader reader(data, size);
+  TagType::Enum type = (TagType::Enum)reader.readU8();
+  if(type == TagType::End) return 0;
+  if(withName) reader.skip(reader.readU16());
+  
+  scanPayload(reader, type, 0, 0, out);
+  return out.size() - count;
+}
+
+void Query::scanPayload(ByteReader &reader, TagType::Enum type, size_t startIndex, size_t i, std::vector<RawMatch> &out) const {
+  if(i == steps.size()) {
+    RawMatch match = { type, startIndex, reader.tell(), 0 };
+    Tag::skipPayload(reader, type);
+    match.endIndex = reader.tell();
+    out.push_back(match);
+    return;
+  }
+  
+  const Step &step = steps[i];
+  
+  switch(step.kind) {
+    case Step::Key:
+    case Step::AnyKey: {
+      if(type != TagType::Compound) break;
+      
+      const std::string &key = step.key.str();
+      for(;;) {
+        size_t childStart = reader.tell();
+        TagType::Enum childType = (TagType::Enum)reader.readU8();
+        if(childType == TagType::End) return;
+        
+        uint16_t nameLength = reader.readU16();
+        const uint8_t *name = reader.take(nameLength);
+        
+        if(step.kind == Step::AnyKey || (nameLength == key.length() && !memcmp(name, key.data(), nameLength)))
+          scanPayload(reader, childType, childStart, i + 1, out);
+        else
+          Tag::skipPayload(reader, childType);
+      }
+    }
+    
+    case Step::Index:
+    case Step::AllEntries: {
+      if(type != TagType::List) break;
+      
+      TagType::Enum entryKind;
+      uint32_t count = Tag::readListHeader(reader, entryKind);
+      if(entryKind == TagType::End) return;
+      
+      if(step.kind == Step::AllEntries) {
+        for(uint32_t j = 0; j < count; ++j) scanPayload(reader, entryKind, reader.tell(), i + 1, out);
+        return;
+      }
+      
+      // Fixed-size entries in front of and behind the one we want are skipped in one go
+      int64_t index = step.index < 0 ? step.index + count : step.index;
+      if(index < 0 || index >= count) {
+        Tag::skipEntries(reader, entryKind, count);
+        return;
+      }
+      
+      Tag::skipEntries(reader, entryKind, (uint32_t)index);
+      scanPayload(reader, entryKind, reader.tell(), i + 1, out);
+      Tag::skipEntries(reader, entryKind, count - (uint32_t)index - 1);
+      return;
+    }
+    
+    case Step::Filter: {
+      // Test on a copy of the reader, then either descend from the original position or skip what the copy read
+      ByteReader probe(reader);
+      if(matchesRaw(probe, type, *step.pattern)) scanPayload(reader, type, startIndex, i + 1, out);
+      else reader.skip(probe.tell() - reader.tell());
+      return;
+    }
+  }
+  
+  Tag::skipPayload(reader, type); // Wrong type for the step
+}
+
+bool Query::matchesRaw(ByteReader &reader, TagType::Enum type, const Pattern &pattern) {
+  if(type != TagType::Compound) {
+    Tag::skipPayload(reader, type);
+    return false;
+  }
+  
+  // Like the tree, later entries with the same key replace the verdict of earlier ones
+  std::vector<char> matched(pattern.fields.size(), 0);
+  
+  for(;;) {
+    TagType::Enum childType = (TagType::Enum)reader.readU8();
+    if(childType == TagType::End) break;
+    
+    uint16_t nameLength = reader.readU16();
+    const uint8_t *name = reader.take(nameLength);
+    
+    size_t field = 0;
+    for(; field < pattern.fields.size(); ++field) {
+      const std::string &key = pattern.fields[field].first;
+      if(key.length() == nameLength && !memcmp(key.data(), name, nameLength)) break;
+    }
+    
+    if(field == pattern.fields.size()) Tag::skipPayload(reader, childType);
+    else matched[field] = matchesRaw(reader, childType, pattern.fields[field].second);
+  }
+  
+  for(size_t field = 0; field < matched.size(); ++field)
+    if(!matched[field]) return false;
+  return true;
+}
+
+bool Query::matchesRaw(ByteReader &reader, TagType::Enum type, const Value &value) {
+  if(value.type != TagType::Unknown && value.type != type) {
+    Tag::skipPayload(reader, type);
+    return false;
+  }
+  
+  Scalar scalar;
+  scalar.type = type;
+  
+  switch(type) {
+    case TagType::Byte: scalar.integer = (int8_t)reader.readU8(); break;
+    case TagType::Short: scalar.integer = (int16_t)reader.readU16(); break;
+    case TagType::Int: scalar.integer = (int32_t)reader.readU32(); break;
+    case TagType::Long: scalar.integer = (int64_t)reader.readU64(); break;
+    
+    case TagType::Float: {
+      uint32_t bits = reader.readU32();
+      float real;
+      memcpy(&real, &bits, 4);
+      scalar.real = real;
+      break;
+    }
+    
+    case TagType::Double: {
+      uint64_t bits = reader.readU64();
+      memcpy(&scalar.real, &bits, 8);
+      break;
+    }
+    
+    case TagType::String: {
+      uint16_t length = reader.readU16();
+      const uint8_t *data = reader.take(length);
+      return value.kind == Value::String && value.string.length() == length && !memcmp(value.string.data(), data, length);
+    }
+    
+    case TagType::Compound:
+      if(value.kind == Value::Compound) return matchesRaw(reader, type, *value.compound);
+      Tag::skipPayload(reader, type);
+      return false;
+      
+    default:
+      Tag::skipPayload(reader, type);
+      return false;
+  }
+  
+  return matchesScalar(scalar, value);
+}
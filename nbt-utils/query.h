@@ -0,0 +1,108 @@
+//
+//  query.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__query__
+#define __nbt_utils__query__
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "nbt_utils.h"
+#include "tag_visitor.h"
+
+namespace nbt {
+  //! A path into a tree, compiled once and then run on any number of trees or encoded documents.
+  //! The syntax follows the game's NBT paths:
+  //!
+  //!     Level.Entities[*].Pos[1]                  keys, list indices ([-1] is the last entry), all entries
+  //!     Level.Entities[{id:"minecraft:zombie"}]   list entries that are compounds with matching fields
+  //!     Level.TileEntities[].Items[{Count:64b}]   [] is the same as [*]
+  //!     Level.*.xPos, Data{version:19133}.Player  any key, filters on the current tag
+  //!     "key with spaces"."a.b"                   quoted keys
+  //!
+  //! Predicate values are strings (quoted, or bare words), numbers (an optional suffix b, s, l, f or d
+  //! also requires that type) and nested compounds. Numbers compare by value across types.
+  //! A query is immutable after compiling, so one instance can be shared by many threads.
+  class Query {
+  public:
+    //! Where a match was found in an encoded document
+    struct RawMatch {
+      TagType::Enum type;
+      size_t startIndex;   //!< Start of the tag including its header (equal to payloadIndex for list entries)
+      size_t payloadIndex; //!< Start of the payload
+      size_t endIndex;     //!< End of the payload
+    };
+    
+    //! Throws a description of the problem if path isn't a valid query
+    explicit Query(const std::string &path);
+    
+    //! Tags reached from root, in document order. Compound keys resolve like TagHash::find,
+    //! i.e. to the last of several entries with the same key.
+    std::vector<Tag *> select(Tag *root) const;
+    Tag *first(Tag *root) const; //!< NULL if nothing matches
+    size_t count(Tag *root) const { return select(root).size(); }
+    
+    //! Runs on an uncompressed encoded document without building a tree: subtrees the query doesn't
+    //! lead into are skipped without being decoded. Matches are appended to out in document order,
+    //! unlike select() every entry of a repeated compound key is considered.
+    //! @return Number of matches appended
+    size_t scan(const uint8_t *data, size_t size, std::vector<RawMatch> &out, bool withName = true) const;
+    
+    //! Decodes a match of scan() into a tag the caller owns
+    static Tag *materialize(const uint8_t *data, const RawMatch &match) {
+      return Tag::read(data + match.payloadIndex, match.endIndex - match.payloadIndex, false, match.type);
+    }
+    
+    const std::string &getPath() const { return path; }
+    
+  private:
+    struct Pattern;
+    
+    struct Value {
+      enum Kind { Integer, Real, String, Compound } kind;
+      TagType::Enum type; //!< Required tag type, Unknown if the value didn't say
+      int64_t integer;
+      double real;
+      std::string string;
+      std::shared_ptr<Pattern> compound;
+    };
+    
+    //! Fields a compound has to contain for a filter to pass
+    struct Pattern {
+      std::vector<std::pair<std::string, Value>> fields;
+    };
+    
+    struct Step {
+      enum Kind {
+        Key,        //!< Entry of a compound
+        AnyKey,     //!< Every entry of a compound
+        Index,      //!< Entry of a list, negative from the end
+        AllEntries, //!< Every entry of a list
+        Filter      //!< Keeps the current tag if it's a compound matching pattern
+      } kind;
+      
+      Name key;
+      int64_t index = 0;
+      std::shared_ptr<Pattern> pattern;
+    };
+    
+    class Parser;
+    
+    void selectFrom(Tag *tag, size_t step, std::vector<Tag *> &out, bool firstOnly) const;
+    static bool matches(const Tag *tag, const Pattern &pattern);
+    static bool matches(const Tag *tag, const Value &value);
+    
+    void scanPayload(ByteReader &reader, TagType::Enum type, size_t startIndex, size_t step, std::vector<RawMatch> &out) const;
+    static bool matchesRaw(ByteReader &reader, TagType::Enum type, const Pattern &pattern);
+    static bool matchesRaw(ByteReader &reader, TagType::Enum type, const Value &value);
+    static bool matchesScalar(const Scalar &scalar, const Value &value);
+    
+    std::string path;
+    std::vector<Step> steps;
+  };
+}
+
+#endif /* defined(__nbt_utils__query__) */
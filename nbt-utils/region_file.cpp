@@ -0,0 +1,122 @@
+//
+//  region_file.cpp
+//  nbt-utils
+//
+
+#include "region_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace nbt;
+
+RegionFile::RegionFile(const std::string &path) : data(NULL), size(0), mapped(false) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) throw "Could not open region file.";
+  
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    close(fd);
+    throw "Could not open region file.";
+  }
+  
+  size = (size_t)st.st_size;
+  if(size > 0) { // Empty region files are valid and just don't contain any chunks.
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+      close(fd);
+      throw "Could not map region file.";
+    }
+    
+    data = (const uint8_t *)map;
+    mapped = true;
+  }
+  close(fd);
+  
+  try {
+    checkHeader();
+  } catch(...) {
+    if(mapped) munmap((void *)data, size);
+    throw;
+  }
+}
+
+RegionFile::RegionFile(const uint8_t *data, size_t size) : data(data), size(size), mapped(false) {
+  checkHeader();
+}
+
+RegionFile::~RegionFile() {
+  if(mapped) munmap((void *)data, size);
+}
+
+void RegionFile::checkHeader() {
+  if(size != 0 && size < 2 * SectorSize) throw "Invalid region file header.";
+}
+
+uint32_t RegionFile::entry(int x, int z) const {
+  if(!size) return 0;
+  
+  uint32_t e;
+  memcpy(&e, data + 4 * ((x & (Width - 1)) + (z & (Width - 1)) * Width), 4);
+  return ntohl(e);
+}
+
+uint32_t RegionFile::getTimestamp(int x, int z) const {
+  if(!size) return 0;
+  
+  uint32_t t;
+  memcpy(&t, data + SectorSize + 4 * ((x & (Width - 1)) + (z & (Width - 1)) * Width), 4);
+  return ntohl(t);
+}
+
+bool RegionFile::getChunkData(int x, int z, const uint8_t *&chunkData, size_t &chunkSize, Compression::Enum &compression) const {
+  uint32_t e = entry(x, z);
+  if(!e) return false;
+  
+  // The upper three bytes are the offset in sectors, the lowest byte is the number of sectors.
+  size_t offset = (size_t)(e >> 8) * SectorSize;
+  if(offset < 2 * SectorSize || offset + 5 > size) throw "Region chunk lies outside the file.";
+  
+  ByteReader reader(data + offset, size - offset, offset);
+  uint32_t length = reader.readU32(); // Includes the compression byte
+  uint8_t type = reader.readU8();
+  
+  if(length < 1) throw "Invalid region chunk length.";
+  if(type & 0x80) throw "Chunks stored in external .mcc files are not supported.";
+  
+  switch(type) {
+    case 1: compression = Compression::Gzip; break;
+    case 2: compression = Compression::Zlib; break;
+    case 3: compression = Compression::None; break;
+    default: throw "Unsupported region chunk compression.";
+  }
+  
+  chunkData = reader.take(length - 1);
+  chunkSize = length - 1;
+  return true;
+}
+
+Tag *RegionFile::readChunk(int x, int z) const {
+  const uint8_t *chunkData;
+  size_t chunkSize;
+  Compression::Enum compression;
+  if(!getChunkData(x, z, chunkData, chunkSize, compression)) return NULL;
+  
+  if(compression == Compression::None) {
+    ByteReader reader(chunkData, chunkSize);
+    return Tag::read(reader);
+  }
+  
+  InflateReader reader(chunkData, chunkSize);
+  return Tag::read(reader);
+}
+
+void RegionFile::iterator::advance(int i) {
+  while(i < Width * Width && !region->hasChunk(i % Width, i / Width)) ++i;
+  
+  index = i;
+  pos.x = i % Width;
+  pos.z = i / Width;
+}
@@ -0,0 +1,90 @@
+//
+//  region_file.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__region_file__
+#define __nbt_utils__region_file__
+
+#include <iterator>
+
+#include "nbt_utils.h"
+
+namespace nbt {
+  //! Position of a chunk inside its region (0-31 on both axes)
+  struct ChunkPos {
+    int x, z;
+  };
+  
+  //! Anvil (.mca) or McRegion (.mcr) file: a 4 KiB offset table, a 4 KiB timestamp table and up to
+  //! 32x32 individually compressed chunks in 4 KiB sectors. Chunks are only decompressed and parsed
+  //! when they are requested. Chunk coordinates are taken modulo 32, so world chunk coordinates work too.
+  class RegionFile {
+  public:
+    static const int Width = 32;
+    static const size_t SectorSize = 4096;
+    
+    //! Memory-maps the file for as long as the RegionFile exists
+    explicit RegionFile(const std::string &path);
+    
+    //! Borrows a region file that is already in memory, the buffer has to outlive the RegionFile
+    RegionFile(const uint8_t *data, size_t size);
+    
+    ~RegionFile();
+    
+    bool hasChunk(int x, int z) const { return entry(x, z) != 0; }
+    uint32_t getTimestamp(int x, int z) const; //!< Last modification in seconds since the epoch
+    
+    //! Locates the compressed payload of a chunk without decoding it, false if the chunk is missing
+    bool getChunkData(int x, int z, const uint8_t *&data, size_t &size, Compression::Enum &compression) const;
+    
+    //! Decompresses and parses a chunk, NULL if it is missing. The caller owns the returned tag.
+    Tag *readChunk(int x, int z) const;
+    Tag *readChunk(const ChunkPos &pos) const { return readChunk(pos.x, pos.z); }
+    
+    //! Iterates over the positions of the chunks that are present
+    class iterator {
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef ChunkPos value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const ChunkPos *pointer;
+      typedef const ChunkPos &reference;
+      
+      reference operator*() const { return pos; }
+      pointer operator->() const { return &pos; }
+      
+      iterator &operator++() { advance(index + 1); return *this; }
+      iterator operator++(int) { iterator it = *this; ++*this; return it; }
+      
+      bool operator==(const iterator &other) const { return index == other.index; }
+      bool operator!=(const iterator &other) const { return index != other.index; }
+      
+    private:
+      friend class RegionFile;
+      iterator(const RegionFile *region, int index) : region(region) { advance(index); }
+      
+      void advance(int i);
+      
+      const RegionFile *region;
+      int index;
+      ChunkPos pos;
+    };
+    
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, Width * Width); }
+    
+  private:
+    RegionFile(const RegionFile &);
+    RegionFile &operator=(const RegionFile &);
+    
+    void checkHeader();
+    uint32_t entry(int x, int z) const;
+    
+    const uint8_t *data;
+    size_t size;
+    bool mapped;
+  };
+}
+
+#endif /* defined(__nbt_utils__region_file__) */
@@ -0,0 +1,620 @@
+//
+//  snbt.cpp
+//  nbt-utils
+//
+
+#include "snbt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <cmath>
+#include <limits>
+
+using namespace nbt;
+
+//! Characters that may appear in unquoted keys, numbers and strings
+static inline bool isBare(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         c == '_' || c == '-' || c == '.' || c == '+';
+}
+
+#pragma mark - Numbers
+
+static const char digitPairs[] =
+  "0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+  "5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+  
+void nbt::appendInteger(std::string &out, int64_t value) {
+  char buffer[20], *end = buffer + sizeof(buffer), *p = end;
+  uint64_t v = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  
+  while(v >= 100) {
+    unsigned pair = (unsigned)(v % 100);
+    v /= 100;
+    p -= 2;
+    memcpy(p, digitPairs + 2 * pair, 2);
+  }
+  
+  if(v >= 10) {
+    p -= 2;
+    memcpy(p, digitPairs + 2 * v, 2);
+  } else
+    *--p = (char)('0' + v);
+    
+  if(value < 0) *--p = '-';
+  out.append(p, end - p);
+}
+
+const char *nbt::parseInteger(const char *p, const char *end, int64_t &value) {
+  bool negative = false;
+  if(p != end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  
+  const uint64_t limit = negative ? (uint64_t)std::numeric_limits<int64_t>::max() + 1 : std::numeric_limits<int64_t>::max();
+  const char *digits = p;
+  uint64_t v = 0;
+  
+  for(; p != end && *p >= '0' && *p <= '9'; ++p) {
+    unsigned digit = *p - '0';
+    if(v > (limit - digit) / 10) return NULL;
+    v = v * 10 + digit;
+  }
+  
+  if(p == digits) return NULL;
+  value = negative ? (int64_t)(0 - v) : (int64_t)v;
+  return p;
+}
+
+//! The C library reads and writes reals with the decimal point of LC_NUMERIC, SNBT always uses '.'
+static const char *decimalPoint() {
+  const char *point = localeconv()->decimal_point;
+  return point && *point ? point : ".";
+}
+
+const char *nbt::parseReal(const char *begin, const char *end, double &value, bool singlePrecision) {
+  const char *point = decimalPoint();
+  size_t pointLength = strlen(point);
+  
+  // strtod needs a terminated copy that has the locale's point instead of '.', and that ends
+  // before anything strtod would take for one (like the ',' in "1,5")
+  char buffer[64];
+  std::string longNumber;
+  char *text = buffer;
+  size_t capacity = (end - begin) * pointLength + 1;
+  if(capacity > sizeof(buffer)) {
+    longNumber.resize(capacity);
+    text = &longNumber[0];
+  }
+  
+  char *q = text;
+  for(const char *p = begin; p != end; ++p) {
+    if(*p == '.') {
+      memcpy(q, point, pointLength);
+      q += pointLength;
+    } else if(*p == *point)
+      break;
+    else
+      *q++ = *p;
+  }
+  *q = 0;
+  
+  char *textEnd;
+  value = singlePrecision ? strtof(text, &textEnd) : strtod(text, &textEnd);
+  if(textEnd == text) return NULL;
+  
+  // Map the end back to the input, where every point is a single '.'
+  const char *p = begin;
+  for(size_t consumed = textEnd - text; consumed; ++p)
+    consumed -= *p == '.' ? pointLength : 1;
+  return p;
+}
+
+void nbt::appendReal(std::string &out, double value, bool singlePrecision) {
+  if(std::isnan(value)) { out += "NaN"; return; }
+  if(std::isinf(value)) { out += value < 0 ? "-Infinity" : "Infinity"; return; }
+  
+  // Whole numbers are common (coordinates, defaults) and don't need printf
+  if(std::fabs(value) < 1e15 && value == std::floor(value)) {
+    if(value == 0 && std::signbit(value)) out += '-';
+    appendInteger(out, (int64_t)value);
+    out += ".0";
+    return;
+  }
+  
+  // FLT_DIG/DBL_DIG digits are enough for every value that has a representation that short,
+  // only the rest needs more digits to read back exactly.
+  const char *point = decimalPoint();
+  size_t pointLength = strlen(point);
+  char buffer[32];
+  int length = 0;
+  for(int precision = singlePrecision ? 6 : 15; precision <= (singlePrecision ? 9 : 17); ++precision) {
+    length = snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if(pointLength != 1 || *point != '.') {
+      if(char *localPoint = strstr(buffer, point)) {
+        *localPoint = '.';
+        memmove(localPoint + 1, localPoint + pointLength, buffer + length + 1 - (localPoint + pointLength));
+        length -= (int)pointLength - 1;
+      }
+    }
+    
+    double parsed;
+    parseReal(buffer, buffer + length, parsed, singlePrecision);
+    if(singlePrecision ? (float)parsed == (float)value : parsed == value) break;
+  }
+  
+  out.append(buffer, length);
+}
+
+#pragma mark - Writer
+
+class SNBTWriter {
+public:
+  SNBTWriter(std::string &out, SNBTStyle::Enum style, unsigned indent)
+  : out(out), pretty(style == SNBTStyle::Pretty), indent(indent), depth(0) {}
+  
+  void write(const Tag *tag) {
+    switch(tag->tagType()) {
+      case TagType::Byte: writeInteger(((const ByteTag *)tag)->value, "b"); break;
+      case TagType::Short: writeInteger(((const ShortTag *)tag)->value, "s"); break;
+      case TagType::Int: writeInteger(((const IntTag *)tag)->value, ""); break;
+      case TagType::Long: writeInteger(((const LongTag *)tag)->value, "L"); break;
+      case TagType::Float: appendReal(out, ((const FloatTag *)tag)->value, true); out += 'f'; break;
+      case TagType::Double: appendReal(out, ((const DoubleTag *)tag)->value); out += 'd'; break;
+      case TagType::ByteArray: writeArray(((const ByteArrayTag *)tag)->value, 'B', "b"); break;
+      case TagType::IntArray: writeArray(((const IntArrayTag *)tag)->value, 'I', ""); break;
+      case TagType::LongArray: writeArray(((const LongArrayTag *)tag)->value, 'L', "L"); break;
+      case TagType::String: writeQuoted(((const StringTag *)tag)->value); break;
+      case TagType::List: writeList((const ListTag *)tag); break;
+      case TagType::Compound: writeCompound(((const CompoundTag *)tag)->value); break;
+      default: throw "End tags can't be written as SNBT.";
+    }
+  }
+  
+private:
+  std::string &out;
+  bool pretty;
+  unsigned indent, depth;
+  
+  void newline() {
+    out += '\n';
+    out.append(depth * indent, ' ');
+  }
+  
+  void separator() {
+    out += ',';
+    if(pretty) out += ' ';
+  }
+  
+  void writeInteger(int64_t value, const char *suffix) {
+    appendInteger(out, value);
+    out += suffix;
+  }
+  
+  // Byte arrays hold signed bytes as far as SNBT is concerned
+  static int64_t element(uint8_t value) { return (int8_t)value; }
+  static int64_t element(int32_t value) { return value; }
+  static int64_t element(int64_t value) { return value; }
+  
+  template<typename T> void writeArray(const Array<T> &array, char kind, const char *suffix) {
+    out += '[';
+    out += kind;
+    out += ';';
+    for(size_t i = 0; i < array.count; ++i) {
+      if(i) separator();
+      else if(pretty) out += ' ';
+      writeInteger(element(array.getElement(i)), suffix);
+    }
+    out += ']';
+  }
+  
+  void writeList(const ListTag *list) {
+    if(list->value.empty()) { out += "[]"; return; }
+    
+    // Lists of numbers or strings stay on one line, everything else gets a line per entry
+    bool multiline = pretty && (list->entryKind == TagType::Compound || list->entryKind == TagType::List ||
+                                list->entryKind == TagType::ByteArray || list->entryKind == TagType::IntArray ||
+                                list->entryKind == TagType::LongArray);
+                                
+    out += '[';
+    ++depth;
+    for(auto it = list->value.begin(); it != list->value.end(); ++it) {
+      if(it != list->value.begin()) {
+        if(multiline) out += ',';
+        else separator();
+      }
+      
+      if(multiline) newline();
+      write(it->get());
+    }
+    --depth;
+    
+    if(multiline) newline();
+    out += ']';
+  }
+  
+  void writeCompound(const TagHash &hash) {
+    if(hash.empty()) { out += "{}"; return; }
+    
+    out += '{';
+    ++depth;
+    for(auto it = hash.begin(); it != hash.end(); ++it) {
+      if(it != hash.begin()) out += ',';
+      if(pretty) newline();
+      
+      writeKey(it->first);
+      out += ':';
+      if(pretty) out += ' ';
+      write(it->second.get());
+    }
+    --depth;
+    
+    if(pretty) newline();
+    out += '}';
+  }
+  
+  void writeKey(const std::string &key) {
+    bool bare = !key.empty();
+    for(size_t i = 0; bare && i < key.length(); ++i) bare = isBare(key[i]);
+    
+    if(bare) out += key;
+    else writeQuoted(key);
+  }
+  
+  //! Uses double quotes unless the string only contains those, unprintable characters are escaped
+  void writeQuoted(const std::string &str) {
+    char quote = str.find('"') != std::string::npos && str.find('\'') == std::string::npos ? '\'' : '"';
+    
+    out += quote;
+    const char *p = str.data(), *end = p + str.length(), *run = p;
+    for(; p != end; ++p) {
+      unsigned char c = *p;
+      if(c != quote && c != '\\' && c >= 0x20) continue;
+      
+      out.append(run, p - run);
+      run = p + 1;
+      
+      switch(c) {
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+          if(c >= 0x20) {
+            out += '\\';
+            out += (char)c;
+          } else {
+            out += "\\u00";
+            out += "0123456789abcdef"[c >> 4];
+            out += "0123456789abcdef"[c & 15];
+          }
+      }
+    }
+    out.append(run, p - run);
+    out += quote;
+  }
+};
+
+std::string nbt::toSNBT(const Tag *tag, SNBTStyle::Enum style, unsigned indent) {
+  std::string out;
+  appendSNBT(out, tag, style, indent);
+  return out;
+}
+
+void nbt::appendSNBT(std::string &out, const Tag *tag, SNBTStyle::Enum style, unsigned indent) {
+  // Clean trees know their encoded size for free, text takes about twice as much
+  if(!tag->isDirty()) out.reserve(out.size() + 2 * Tag::encodedSize(tag, false));
+  
+  SNBTWriter(out, style, indent).write(tag);
+}
+
+#pragma mark - Reader
+
+class SNBTReader {
+public:
+  SNBTReader(const char *text, size_t length) : p(text), end(text + length), depth(0) {}
+  
+  Tag *parse() {
+    std::unique_ptr<Tag> tag(parseValue());
+    skipSpace();
+    if(p != end) throw "Invalid SNBT: unexpected text after the value.";
+    return tag.release();
+  }
+  
+private:
+  static const unsigned MaxDepth = 512; //!< Same limit as the game's
+  
+  const char *p, *end;
+  unsigned depth;
+  
+  struct Nesting {
+    SNBTReader &reader;
+    
+    Nesting(SNBTReader &reader) : reader(reader) {
+      if(++reader.depth > MaxDepth) throw "Invalid SNBT: nested too deeply.";
+    }
+    ~Nesting() { --reader.depth; }
+  };
+  
+  void skipSpace() { while(p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p; }
+  
+  //! Skips whitespace and reports whether the next character is c, which is then consumed
+  bool accept(char c) {
+    skipSpace();
+    if(p == end || *p != c) return false;
+    ++p;
+    return true;
+  }
+  
+  Tag *parseValue() {
+    skipSpace();
+    if(p == end) throw "Invalid SNBT: expected a value.";
+    
+    switch(*p) {
+      case '{': return parseCompound();
+      case '[': return parseList();
+      case '"': case '\'': {
+        std::unique_ptr<StringTag> tag(new StringTag());
+        parseQuoted(tag->value);
+        return tag.release();
+      }
+      default: return parseWord();
+    }
+  }
+  
+  Tag *parseCompound() {
+    Nesting nesting(*this);
+    std::unique_ptr<CompoundTag> tag(new CompoundTag());
+    
+    ++p; // {
+    if(accept('}')) return tag.release();
+    
+    do {
+      if(accept('}')) return tag.release(); // Trailing comma
+      
+      Name key = parseKey();
+      if(!accept(':')) throw "Invalid SNBT: expected ':' after a key.";
+      
+      // Named like entries read from binary. Repeated keys are kept, lookups see the last one (see TagHash)
+      std::shared_ptr<Tag> entry(parseValue());
+      entry->name = key;
+      entry->hasName = true;
+      tag->value.append(key, entry);
+    } while(accept(','));
+    
+    if(!accept('}')) throw "Invalid SNBT: expected ',' or '}' in a compound.";
+    return tag.release();
+  }
+  
+  Name parseKey() {
+    skipSpace();
+    if(p != end && (*p == '"' || *p == '\'')) {
+      std::string key;
+      parseQuoted(key);
+      return Name(key);
+    }
+    
+    const char *start = p;
+    while(p != end && isBare(*p)) ++p;
+    if(p == start) throw "Invalid SNBT: expected a key.";
+    return Name(start, p - start);
+  }
+  
+  Tag *parseList() {
+    Nesting nesting(*this);
+    ++p; // [
+    
+    if(end - p >= 2 && p[1] == ';') {
+      switch(p[0]) {
+        case 'B': p += 2; return parseArray<ByteArrayTag, uint8_t>('b', INT8_MIN, INT8_MAX);
+        case 'I': p += 2; return parseArray<IntArrayTag, int32_t>(0, INT32_MIN, INT32_MAX);
+        case 'L': p += 2; return parseArray<LongArrayTag, int64_t>('l', INT64_MIN, INT64_MAX);
+        default: throw "Invalid SNBT: unknown array type.";
+      }
+    }
+    
+    std::unique_ptr<ListTag> list(new ListTag());
+    list->entryKind = TagType::End;
+    if(accept(']')) return list.release();
+    
+    do {
+      if(accept(']')) return list.release(); // Trailing comma
+      
+      std::shared_ptr<Tag> entry(parseValue());
+      if(list->value.empty()) list->entryKind = entry->tagType();
+      else if(entry->tagType() != list->entryKind) throw "Invalid SNBT: list entries must have the same type.";
+      
+      entry->parent = list.get();
+      list->value.push_back(entry);
+    } while(accept(','));
+    
+    if(!accept(']')) throw "Invalid SNBT: expected ',' or ']' in a list.";
+    return list.release();
+  }
+  
+  //! Elements are integers with the given suffix (which is optional, 0 for none) in [min, max]
+  template<typename T, typename Element> Tag *parseArray(char suffix, int64_t min, int64_t max) {
+    std::vector<Element> values;
+    
+    if(!accept(']')) {
+      do {
+        skipSpace();
+        if(p != end && *p == ']') break; // Trailing comma
+        
+        const char *start = p;
+        while(p != end && isBare(*p)) ++p;
+        
+        int64_t value;
+        const char *digitsEnd = parseInteger(start, p, value);
+        if(!digitsEnd) throw "Invalid SNBT: expected an integer in an array.";
+        if(digitsEnd != p && !(suffix && digitsEnd + 1 == p && (*digitsEnd | 0x20) == suffix))
+          throw "Invalid SNBT: array element has the wrong type.";
+        if(value < min || value > max) throw "Invalid SNBT: array element out of range.";
+        
+        values.push_back((Element)value);
+      } while(accept(','));
+      
+      if(!accept(']')) throw "Invalid SNBT: expected ',' or ']' in an array.";
+    }
+    
+    T *tag = new T();
+    tag->value.allocate(values.size());
+    if(!values.empty()) memcpy(tag->value.data.get(), values.data(), values.size() * sizeof(Element));
+    return tag;
+  }
+  
+  //! Number, true/false or unquoted string
+  Tag *parseWord() {
+    const char *start = p;
+    while(p != end && isBare(*p)) ++p;
+    if(p == start) throw "Invalid SNBT: expected a value.";
+    
+    if(Tag *number = parseNumber(start, p)) return number;
+    
+    size_t length = p - start;
+    if(length == 4 && !memcmp(start, "true", 4)) return new ByteTag(1);
+    if(length == 5 && !memcmp(start, "false", 5)) return new ByteTag(0);
+    
+    return new StringTag(std::string(start, length));
+  }
+  
+  //! NULL if the word isn't a number or is out of range for its type
+  static Tag *parseNumber(const char *begin, const char *end) {
+    char suffix = end[-1] | 0x20; // Lower case for letters
+    
+    int64_t value;
+    const char *digitsEnd = parseInteger(begin, end, value);
+    if(digitsEnd == end)
+      return value >= INT32_MIN && value <= INT32_MAX ? new IntTag((int32_t)value) : NULL;
+      
+    if(digitsEnd && digitsEnd + 1 == end) {
+      switch(suffix) {
+        case 'b': return value >= INT8_MIN && value <= INT8_MAX ? new ByteTag((int8_t)value) : NULL;
+        case 's': return value >= INT16_MIN && value <= INT16_MAX ? new ShortTag((int16_t)value) : NULL;
+        case 'l': return new LongTag(value);
+      }
+    }
+    
+    bool hasSuffix = suffix == 'f' || suffix == 'd';
+    const char *numberEnd = hasSuffix ? end - 1 : end;
+    if(!isReal(begin, numberEnd, hasSuffix)) return NULL;
+    
+    double real;
+    parseReal(begin, numberEnd, real, suffix == 'f');
+    if(suffix == 'f') return new FloatTag((float)real);
+    return new DoubleTag(real);
+  }
+  
+  //! Decimal number with a fraction or exponent (either is optional if there's a suffix), NaN or Infinity
+  static bool isReal(const char *p, const char *end, bool hasSuffix) {
+    if(p != end && (*p == '-' || *p == '+')) ++p;
+    
+    size_t length = end - p;
+    if(hasSuffix && ((length == 3 && !memcmp(p, "NaN", 3)) || (length == 8 && !memcmp(p, "Infinity", 8)))) return true;
+    
+    size_t digits = 0;
+    bool point = false, exponent = false;
+    
+    for(; p != end && *p >= '0' && *p <= '9'; ++p) ++digits;
+    if(p != end && *p == '.') {
+      point = true;
+      for(++p; p != end && *p >= '0' && *p <= '9'; ++p) ++digits;
+    }
+    if(!digits) return false;
+    
+    if(p != end && (*p | 0x20) == 'e') {
+      exponent = true;
+      if(++p != end && (*p == '-' || *p == '+')) ++p;
+      
+      const char *exponentDigits = p;
+      while(p != end && *p >= '0' && *p <= '9') ++p;
+      if(p == exponentDigits) return false;
+    }
+    
+    return p == end && (hasSuffix || point || exponent);
+  }
+  
+  void parseQuoted(std::string &out) {
+    char quote = *p++;
+    const char *run = p;
+    
+    for(;;) {
+      if(p == end) throw "Invalid SNBT: unterminated string.";
+      
+      char c = *p;
+      if(c == quote) {
+        out.append(run, p - run);
+        ++p;
+        return;
+      }
+      
+      if(c != '\\') {
+        ++p;
+        continue;
+      }
+      
+      out.append(run, p - run);
+      if(++p == end) throw "Invalid SNBT: unterminated string.";
+      
+      switch(*p++) {
+        case '\\': out += '\\'; break;
+        case '"': out += '"'; break;
+        case '\'': out += '\''; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': appendUTF8(out, parseCodePoint()); break;
+        default: throw "Invalid SNBT: unknown escape sequence.";
+      }
+      run = p;
+    }
+  }
+  
+  //! The code point of a \u escape (after the u), surrogate pairs are combined
+  uint32_t parseCodePoint() {
+    uint32_t unit = parseHex4();
+    if(unit >= 0xd800 && unit < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+      const char *save = p;
+      p += 2;
+      uint32_t low = parseHex4();
+      if(low >= 0xdc00 && low < 0xe000) return 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+      p = save;
+    }
+    return unit;
+  }
+  
+  uint32_t parseHex4() {
+    if(end - p < 4) throw "Invalid SNBT: incomplete \\u escape.";
+    
+    uint32_t value = 0;
+    for(int i = 0; i < 4; ++i) {
+      char c = *p++;
+      int digit = c >= '0' && c <= '9' ? c - '0' : ((c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1);
+      if(digit < 0) throw "Invalid SNBT: incomplete \\u escape.";
+      value = value << 4 | digit;
+    }
+    return value;
+  }
+  
+  static void appendUTF8(std::string &out, uint32_t c) {
+    if(c < 0x80) out += (char)c;
+    else if(c < 0x800) {
+      out += (char)(0xc0 | c >> 6);
+      out += (char)(0x80 | (c & 0x3f));
+    } else if(c < 0x10000) {
+      out += (char)(0xe0 | c >> 12);
+      out += (char)(0x80 | (c >> 6 & 0x3f));
+      out += (char)(0x80 | (c & 0x3f));
+    } else {
+      out += (char)(0xf0 | c >> 18);
+      out += (char)(0x80 | (c >> 12 & 0x3f));
+      out += (char)(0x80 | (c >> 6 & 0x3f));
+      out += (char)(0x80 | (c & 0x3f));
+    }
+  }
+};
+
+Tag *nbt::parseSNBT(const char *text, size_t length) {
+  return SNBTReader(text, length).parse();
+}
@@ -0,0 +1,68 @@
+//
+//  snbt.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__snbt__
+#define __nbt_utils__snbt__
+
+#include <string>
+
+#include "nbt_utils.h"
+
+// SNBT is the text form of NBT the game uses in commands and data packs:
+//
+//     {Name:"Steve",Pos:[0.5d,64.0d,-3.5d],Inventory:[{id:"minecraft:stone",Count:64b}],Seed:-42L,Heights:[L;1L,2L]}
+//
+// Numbers are formatted and parsed by hand into a single output buffer, no iostreams involved.
+
+namespace nbt {
+  struct SNBTStyle {
+#ifdef EMSCRIPTEN
+    // (emscripten)
+    // Using chars instead of an enum-values makes bindings easier.
+    
+    typedef char Enum;
+    enum Values : char {
+#else
+    enum Enum : char {
+#endif
+      Compact = 0, //!< Everything on one line without spaces
+      Pretty  = 1  //!< Compound entries and lists of compounds, lists or arrays get a line each, indented
+    };
+  };
+  
+  //! Text for tag and its subtree. The name of tag itself isn't part of the output.
+  //! Floats and doubles are written with as few digits as still read back to the same value.
+  std::string toSNBT(const Tag *tag, SNBTStyle::Enum style = SNBTStyle::Compact, unsigned indent = 4);
+  
+  //! Same as toSNBT, but appends to out
+  void appendSNBT(std::string &out, const Tag *tag, SNBTStyle::Enum style = SNBTStyle::Compact, unsigned indent = 4);
+  
+  //! Parses one value (surrounding whitespace is allowed) into a new, unnamed tag the caller owns.
+  //! Like in the game, unquoted words that aren't numbers are strings, true/false are bytes and
+  //! numbers out of range for their type are strings as well.
+  //! Throws a description of the problem if the text isn't valid SNBT.
+  Tag *parseSNBT(const char *text, size_t length);
+  inline Tag *parseSNBT(const std::string &text) { return parseSNBT(text.data(), text.length()); }
+  
+#pragma mark - Numbers
+  
+  //! Appends the decimal digits of value
+  void appendInteger(std::string &out, int64_t value);
+  
+  //! Parses an optionally signed decimal integer at the start of [begin, end).
+  //! @return End of the digits, NULL if there are none or the value doesn't fit in 64 bits
+  const char *parseInteger(const char *begin, const char *end, int64_t &value);
+  
+  //! Parses a real number at the start of [begin, end) like strtod (strtof if singlePrecision) does
+  //! in the "C" locale, whatever LC_NUMERIC is.
+  //! @return End of the number, NULL if there is none
+  const char *parseReal(const char *begin, const char *end, double &value, bool singlePrecision = false);
+  
+  //! Shortest text that reads back as value (1.5, 0.1, 1e+30, ...), integral values keep a ".0".
+  //! The decimal point is always '.', whatever LC_NUMERIC is.
+  void appendReal(std::string &out, double value, bool singlePrecision = false);
+}
+
+#endif /* defined(__nbt_utils__snbt__) */
@@ -0,0 +1,108 @@
+//
+//  tag_visitor.cpp
+//  nbt-utils
+//
+
+#include "tag_visitor.h"
+
+using namespace nbt;
+
+static void visitPayload(ByteReader &reader, TagVisitor &visitor, const NameRef &name, TagType::Enum type) {
+  Scalar scalar;
+  scalar.type = type;
+  
+  switch(type) {
+    case TagType::End: break;
+    
+    case TagType::Byte: scalar.integer = (int8_t)reader.readU8(); visitor.scalar(name, scalar); break;
+    case TagType::Short: scalar.integer = (int16_t)reader.readU16(); visitor.scalar(name, scalar); break;
+    case TagType::Int: scalar.integer = (int32_t)reader.readU32(); visitor.scalar(name, scalar); break;
+    case TagType::Long: scalar.integer = (int64_t)reader.readU64(); visitor.scalar(name, scalar); break;
+    
+    case TagType::Float: {
+      uint32_t bits = reader.readU32();
+      float value;
+      memcpy(&value, &bits, 4);
+      scalar.real = value;
+      visitor.scalar(name, scalar);
+      break;
+    }
+    
+    case TagType::Double: {
+      uint64_t bits = reader.readU64();
+      memcpy(&scalar.real, &bits, 8);
+      visitor.scalar(name, scalar);
+      break;
+    }
+    
+    case TagType::String: {
+      uint16_t length = reader.readU16();
+      visitor.string(name, (const char *)reader.take(length), length);
+      break;
+    }
+    
+    case TagType::ByteArray:
+    case TagType::IntArray:
+    case TagType::LongArray: {
+      uint32_t count = reader.readU32();
+      size_t elementSize = type == TagType::ByteArray ? 1 : type == TagType::IntArray ? 4 : 8;
+      visitor.array(name, type, reader.take(count * elementSize), count);
+      break;
+    }
+    
+    case TagType::List: {
+      TagType::Enum entryKind;
+      uint32_t count = Tag::readListHeader(reader, entryKind);
+      
+      if(!visitor.beginList(name, entryKind, count)) {
+        Tag::skipEntries(reader, entryKind, count);
+        break;
+      }
+      
+      NameRef unnamed = { "", 0 };
+      if(entryKind != TagType::End)
+        for(uint32_t i = 0; i < count; ++i) visitPayload(reader, visitor, unnamed, entryKind);
+      
+      visitor.endList();
+      break;
+    }
+    
+    case TagType::Compound: {
+      if(!visitor.beginCompound(name)) {
+        Tag::skipPayload(reader, type);
+        break;
+      }
+      
+      // Streaming readers move their window on the next read, so keys are copied out of the input.
+      // One buffer serves all entries of the compound, so its capacity is reused.
+      std::string key;
+      TagType::Enum childType;
+      while((childType = (TagType::Enum)reader.readU8()) != TagType::End) {
+        uint16_t length = reader.readU16();
+        key.assign((const char *)reader.take(length), length);
+        
+        NameRef childName = { key.data(), key.length() };
+        visitPayload(reader, visitor, childName, childType);
+      }
+      
+      visitor.endCompound();
+      break;
+    }
+    
+    default: throw "Unknown NBT tag type.";
+  }
+}
+
+void nbt::visit(ByteReader &reader, TagVisitor &visitor, bool withName, TagType::Enum type) {
+  if(type == TagType::Unknown) type = (TagType::Enum)reader.readU8();
+  if(type == TagType::End) return;
+  
+  std::string key;
+  if(withName) {
+    uint16_t length = reader.readU16();
+    key.assign((const char *)reader.take(length), length);
+  }
+  
+  NameRef name = { key.data(), key.length() };
+  visitPayload(reader, visitor, name, type);
+}
@@ -0,0 +1,60 @@
+//
+//  tag_visitor.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__tag_visitor__
+#define __nbt_utils__tag_visitor__
+
+#include "nbt_utils.h"
+
+namespace nbt {
+  //! Name of a tag (empty for list entries), only valid during the call it is passed to
+  struct NameRef {
+    const char *data;
+    size_t length;
+    
+    std::string str() const { return std::string(data, length); }
+    bool operator==(const std::string &other) const { return other.length() == length && !memcmp(other.data(), data, length); }
+    bool operator!=(const std::string &other) const { return !(*this == other); }
+  };
+  
+  //! Value of a Byte, Short, Int, Long, Float or Double tag
+  struct Scalar {
+    TagType::Enum type;
+    union {
+      int64_t integer; //!< Byte, Short, Int and Long (sign-extended)
+      double real;     //!< Float and Double
+    };
+  };
+  
+  //! Receives the events emitted by visit(). Returning false from beginCompound or beginList skips
+  //! that subtree, its end event is then not emitted either. Names, strings and array data are only
+  //! valid during the call they are passed to (streaming readers reuse their buffer), copy them to keep them.
+  class TagVisitor {
+  public:
+    virtual ~TagVisitor() {}
+    
+    virtual bool beginCompound(const NameRef &name) { return true; }
+    virtual void endCompound() {}
+    
+    virtual bool beginList(const NameRef &name, TagType::Enum entryKind, uint32_t count) { return true; }
+    virtual void endList() {}
+    
+    virtual void scalar(const NameRef &name, const Scalar &value) {}
+    virtual void string(const NameRef &name, const char *data, size_t length) {}
+    
+    //! ByteArray, IntArray or LongArray, data points to the count elements in wire (big-endian) order
+    virtual void array(const NameRef &name, TagType::Enum type, const uint8_t *data, uint32_t count) {}
+  };
+  
+  //! Streams the events for one tag straight from the input, without building Tag objects
+  void visit(ByteReader &reader, TagVisitor &visitor, bool withName = true, TagType::Enum type = TagType::Unknown);
+  
+  inline void visit(const uint8_t *data, size_t size, TagVisitor &visitor, bool withName = true, TagType::Enum type = TagType::Unknown) {
+    ByteReader reader(data, size);
+    visit(reader, visitor, withName, type);
+  }
+}
+
+#endif /* defined(__nbt_utils__tag_visitor__) */
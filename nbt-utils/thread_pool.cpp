@@ -0,0 +1,161 @@
+//
+//  thread_pool.cpp
+//  nbt-utils
+//
+
+#include "thread_pool.h"
+
+using namespace nbt;
+
+#if NBT_THREADS
+
+//! Pool and worker index of the task the current thread is running, if any
+static thread_local const ThreadPool *currentPool = NULL;
+static thread_local unsigned currentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned threadCount)
+: threadCount(threadCount), task(NULL), generation(0), active(0), stopping(false) {
+  if(this->threadCount == 0) this->threadCount = std::thread::hardware_concurrency();
+  if(this->threadCount == 0) this->threadCount = 1; // Unknown
+  
+  queues.resize(this->threadCount);
+  
+  // Worker 0 is whoever calls run().
+  for(unsigned worker = 1; worker < this->threadCount; ++worker)
+    threads.push_back(std::thread(&ThreadPool::workerMain, this, worker));
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  
+  for(size_t i = 0; i < threads.size(); ++i) threads[i].join();
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t, unsigned)> &task) {
+  if(count == 0) return;
+  
+  if(currentPool == this) {
+    std::exception_ptr error;
+    for(size_t index = 0; index < count; ++index) {
+      try {
+        task(index, currentWorker);
+      } catch(...) {
+        if(!error) error = std::current_exception();
+      }
+    }
+    
+    if(error) std::rethrow_exception(error);
+    return;
+  }
+  
+  std::lock_guard<std::mutex> runLock(runMutex);
+  
+  for(unsigned i = 0; i < threadCount; ++i) {
+    std::lock_guard<std::mutex> lock(queues[i].mutex);
+    queues[i].begin = count * i / threadCount;
+    queues[i].end = count * (i + 1) / threadCount;
+  }
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    error = std::exception_ptr();
+    active = threadCount - 1;
+    ++generation;
+  }
+  wake.notify_all();
+  
+  work(0);
+  
+  // The queues are empty now, but other workers might still be busy with their last task.
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return active == 0; });
+  
+  this->task = NULL;
+  if(error) std::rethrow_exception(error);
+}
+
+void ThreadPool::workerMain(unsigned worker) {
+  unsigned seen = 0;
+  
+  for(;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if(stopping) return;
+      seen = generation;
+    }
+    
+    work(worker);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    if(--active == 0) done.notify_one();
+  }
+}
+
+void ThreadPool::work(unsigned worker) {
+  // Saved, because the caller of run() may itself be a task of another pool
+  const ThreadPool *outerPool = currentPool;
+  unsigned outerWorker = currentWorker;
+  currentPool = this;
+  currentWorker = worker;
+  
+  size_t index;
+  while(pop(worker, index)) {
+    try {
+      (*task)(index, worker);
+    } catch(...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(!error) error = std::current_exception();
+    }
+  }
+  
+  currentPool = outerPool;
+  currentWorker = outerWorker;
+}
+
+bool ThreadPool::pop(unsigned worker, size_t &index) {
+  {
+    Queue &own = queues[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if(own.begin < own.end) {
+      index = own.begin++;
+      return true;
+    }
+  }
+  
+  for(unsigned i = 1; i < threadCount; ++i) {
+    Queue &victim = queues[(worker + i) % threadCount];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if(victim.begin < victim.end) {
+      index = --victim.end;
+      return true;
+    }
+  }
+  
+  return false;
+}
+
+#else
+
+ThreadPool::ThreadPool(unsigned) : threadCount(1) {}
+ThreadPool::~ThreadPool() {}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t, unsigned)> &task) {
+  std::exception_ptr error;
+  for(size_t index = 0; index < count; ++index) {
+    try {
+      task(index, 0);
+    } catch(...) {
+      if(!error) error = std::current_exception();
+    }
+  }
+  
+  if(error) std::rethrow_exception(error);
+}
+
+#endif
@@ -0,0 +1,79 @@
+//
+//  thread_pool.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__thread_pool__
+#define __nbt_utils__thread_pool__
+
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <exception>
+
+// (emscripten)
+// Without -pthread there are no threads to spawn, so the pool runs everything on the calling thread.
+#if !defined(EMSCRIPTEN) || defined(__EMSCRIPTEN_PTHREADS__)
+#define NBT_THREADS 1
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#else
+#define NBT_THREADS 0
+#endif
+
+namespace nbt {
+  //! Fixed set of worker threads that run index-based batches. Every worker starts on its own
+  //! contiguous slice of the batch and steals from the back of the other slices once it runs dry,
+  //! so uneven task sizes (e.g. empty vs. fully built chunks) still keep all cores busy.
+  class ThreadPool {
+  public:
+    //! @param threadCount Number of threads including the caller, 0 for one per hardware thread
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+    
+    //! Number of threads that take part in run(), including the calling thread
+    unsigned getThreadCount() const { return threadCount; }
+    
+    //! Calls task(index, worker) for every index in [0, count) and returns once all calls are done.
+    //! worker is in [0, getThreadCount()) and identifies the calling thread, so tasks can use
+    //! per-worker scratch space without locking. The first exception thrown by a task is rethrown here.
+    //! Called from inside a task of the same pool, the nested batch runs on the calling thread with
+    //! that task's worker index (the other workers are busy with the outer batch, waiting for them
+    //! would deadlock), so tasks of both batches must not share per-worker scratch space.
+    void run(size_t count, const std::function<void(size_t, unsigned)> &task);
+    
+  private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+    
+    unsigned threadCount;
+    
+#if NBT_THREADS
+    struct Queue {
+      std::mutex mutex;
+      size_t begin, end; //!< Indices left to process, the owner pops from the front, thieves from the back
+    };
+    
+    void workerMain(unsigned worker);
+    void work(unsigned worker);
+    bool pop(unsigned worker, size_t &index);
+    
+    std::vector<std::thread> threads;
+    std::deque<Queue> queues; // deque, because mutexes can't be moved
+    
+    std::mutex runMutex; //!< Serializes concurrent run() calls
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    
+    const std::function<void(size_t, unsigned)> *task;
+    unsigned generation, active;
+    bool stopping;
+    
+    std::exception_ptr error;
+#endif
+  };
+}
+
+#endif /* defined(__nbt_utils__thread_pool__) */
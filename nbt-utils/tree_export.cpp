@@ -0,0 +1,116 @@
+//
+//  tree_export.cpp
+//  nbt-utils
+//
+
+#include "tree_export.h"
+
+using namespace nbt;
+
+//! Number of entries of a compound or list, 0 for all other tags
+static size_t containerSize(const Tag *tag) {
+  switch(tag->tagType()) {
+    case TagType::List: return ((const ListTag *)tag)->value.size();
+    case TagType::Compound: return ((const CompoundTag *)tag)->value.size();
+    default: return 0;
+  }
+}
+
+TreeExport::TreeExport(Tag *root, int maxDepth, size_t pageSize) : maxDepth(maxDepth), pageSize(pageSize) {
+  buffer.reserve(64 << 10);
+  putU32(0); // Node count, see finish
+  
+  add(root, 0xffffffff, NULL, 0);
+  finish();
+}
+
+TreeExport::TreeExport(Tag *container, size_t offset, size_t count, int maxDepth, size_t pageSize)
+: maxDepth(maxDepth), pageSize(pageSize) {
+  putU32(0);
+  
+  size_t total = containerSize(container);
+  size_t begin = offset < total ? offset : total;
+  size_t end = count < total - begin ? begin + count : total;
+  
+  addEntries(container, 0xffffffff, begin, end, 0);
+  finish();
+}
+
+void TreeExport::finish() {
+  uint32_t count = htonl((uint32_t)tags.size());
+  buffer.replace(0, 4, (const char *)&count, 4);
+}
+
+void TreeExport::putString(const std::string &str) {
+  size_t length = str.length() < 0xffff ? str.length() : 0xffff; // NBT can't encode longer strings anyway
+  putU16((uint16_t)length);
+  buffer.append(str.data(), length);
+}
+
+void TreeExport::add(Tag *tag, uint32_t parent, const Name *key, int depth) {
+  uint32_t id = (uint32_t)tags.size();
+  tags.push_back(tag);
+  
+  TagType::Enum type = tag->tagType();
+  bool expand = maxDepth < 0 || depth < maxDepth;
+  
+  size_t count = containerSize(tag);
+  switch(type) {
+    case TagType::ByteArray: count = ((ByteArrayTag *)tag)->value.getCount(); break;
+    case TagType::IntArray: count = ((IntArrayTag *)tag)->value.getCount(); break;
+    case TagType::LongArray: count = ((LongArrayTag *)tag)->value.getCount(); break;
+    default: break;
+  }
+  
+  bool hasChildren = count && (type == TagType::List || type == TagType::Compound);
+  size_t exported = !hasChildren || !expand ? 0 : pageSize && pageSize < count ? pageSize : count;
+  bool hasKey = key && *key != tag->name;
+  
+  putU8(type);
+  putU8((tag->hasName ? HasName : 0) | (exported < count && hasChildren ? ChildrenOmitted : 0) | (hasKey ? HasKey : 0));
+  putU32(parent);
+  putU32((uint32_t)count);
+  putU32((uint32_t)tag->getStartIndex());
+  putU32((uint32_t)tag->getEndIndex());
+  putString(tag->name);
+  if(hasKey) putString(*key);
+  
+  switch(type) {
+    case TagType::Byte: putU8(((ByteTag *)tag)->value); break;
+    case TagType::Short: putU16(((ShortTag *)tag)->value); break;
+    case TagType::Int: putU32(((IntTag *)tag)->value); break;
+    case TagType::Long: putU64(((LongTag *)tag)->value); break;
+    
+    case TagType::Float: {
+      uint32_t bits;
+      memcpy(&bits, &((FloatTag *)tag)->value, 4);
+      putU32(bits);
+      break;
+    }
+    
+    case TagType::Double: {
+      uint64_t bits;
+      memcpy(&bits, &((DoubleTag *)tag)->value, 8);
+      putU64(bits);
+      break;
+    }
+    
+    case TagType::String: putString(((StringTag *)tag)->value); break;
+    case TagType::List: putU8(((ListTag *)tag)->entryKind); break;
+    default: break;
+  }
+  
+  addEntries(tag, id, 0, exported, depth + 1);
+}
+
+void TreeExport::addEntries(Tag *container, uint32_t parent, size_t begin, size_t end, int depth) {
+  // Walk the containers in place, getValue() would copy them
+  if(container->tagType() == TagType::List) {
+    const std::vector<std::shared_ptr<Tag>> &entries = ((ListTag *)container)->value;
+    for(size_t i = begin; i < end; ++i) add(entries[i].get(), parent, NULL, depth);
+  } else if(container->tagType() == TagType::Compound) {
+    const TagHash &hash = ((CompoundTag *)container)->value;
+    for(TagHash::const_iterator it = hash.begin() + begin; it != hash.begin() + end; ++it)
+      add(it->second.get(), parent, &it->first, depth);
+  }
+}
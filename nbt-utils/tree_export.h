@@ -0,0 +1,78 @@
+//
+//  tree_export.h
+//  nbt-utils
+//
+
+#ifndef __nbt_utils__tree_export__
+#define __nbt_utils__tree_export__
+
+#include <vector>
+#include <string>
+
+#include "nbt_utils.h"
+
+namespace nbt {
+  //! Flattens a tree (or its top levels) into one buffer that a UI can build its view from in a
+  //! single pass, instead of asking every tag for its type, name and value separately.
+  //!
+  //! Nodes are numbered in pre-order starting with 0 for the root. The buffer is big-endian:
+  //!
+  //!     u32 nodeCount
+  //!     nodeCount times:
+  //!       u8  type
+  //!       u8  flags       (see Flags)
+  //!       u32 parent      node id, 0xffffffff for the root
+  //!       u32 count       entries of a compound or list, elements of an array, 0 otherwise
+  //!       u32 startIndex  byte range of the tag as of its last read or write
+  //!       u32 endIndex
+  //!       u16 length + name bytes
+  //!       u16 length + key bytes, if HasKey is set
+  //!       value: i8/i16/i32/i64 for integers, IEEE bits for Float/Double,
+  //!              u16 length + bytes for strings, u8 entry kind for lists, nothing for the others
+  //!
+  //! Strings are copied as stored, i.e. UTF-8 (strictly speaking Java's modified UTF-8).
+  //! The children of a node follow it directly, so a list entry's index is its position among its siblings
+  //! (plus the offset, for the entries of a range export).
+  //!
+  //! Huge lists and compounds can be paged: pageSize caps the entries exported per container and
+  //! the remaining ones are fetched later with a range export.
+  class TreeExport {
+  public:
+    enum Flags {
+      HasName = 1,         //!< The tag is named (the name is written either way)
+      ChildrenOmitted = 2, //!< Some or all entries were not exported because of maxDepth or pageSize
+      HasKey = 4           //!< Compound entry whose key differs from the tag's name
+    };
+    
+    //! @param maxDepth Deepest level to export (the root is level 0), negative for the whole tree
+    //! @param pageSize Most entries to export per compound or list, 0 for no limit
+    explicit TreeExport(Tag *root, int maxDepth = -1, size_t pageSize = 0);
+    
+    //! Exports entries [offset, offset + count) of a compound or list, each of them as a root node
+    //! with its parent set to 0xffffffff. The range is clamped to the entries there are.
+    TreeExport(Tag *container, size_t offset, size_t count, int maxDepth, size_t pageSize);
+    
+    size_t getNodeCount() const { return tags.size(); }
+    Tag *getTag(size_t id) const { return tags[id]; } //!< Valid until the tag is removed from its tree
+    
+    const std::string &getBuffer() const { return buffer; }
+    
+  private:
+    void add(Tag *tag, uint32_t parent, const Name *key, int depth);
+    void addEntries(Tag *container, uint32_t parent, size_t begin, size_t end, int depth);
+    void finish();
+    
+    void putU8(uint8_t v) { buffer += (char)v; }
+    void putU16(uint16_t v) { v = htons(v); buffer.append((const char *)&v, 2); }
+    void putU32(uint32_t v) { v = htonl(v); buffer.append((const char *)&v, 4); }
+    void putU64(uint64_t v) { v = htonll(v); buffer.append((const char *)&v, 8); }
+    void putString(const std::string &str);
+    
+    int maxDepth;
+    size_t pageSize;
+    std::vector<Tag *> tags; //!< By node id
+    std::string buffer;
+  };
+}
+
+#endif /* defined(__nbt_utils__tree_export__) */
@@ -10,96 +10,226 @@
 
 #include <zlib.h>
 #include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
 
-// based on http://www.zlib.net/zpipe.c
-std::string zlibInflate(const std::string &input) {
-  z_stream strm;
-  const unsigned char *in = (const unsigned char *)input.c_str();
+#include "thread_pool.h"
+
+Compression::Enum detectCompression(const uint8_t *data, size_t size) {
+  if(size >= 2 && data[0] == 0x1f && data[1] == 0x8b) return Compression::Gzip;
   
-#define CHUNK (256<<10)
-  std::string out = "";
-  unsigned char out_buffer[CHUNK];
+  // CMF: deflate with a window of at most 32K, FLG: the header checksum has to work out.
+  if(size >= 2 && (data[0] & 0x0f) == Z_DEFLATED && (data[0] >> 4) <= 7 && ((data[0] << 8) | data[1]) % 31 == 0)
+    return Compression::Zlib;
   
-  // allocate inflate state
+  return Compression::None;
+}
+
+std::string zlibInflate(const std::string &input) {
+  z_stream strm;
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
   strm.opaque = Z_NULL;
   strm.avail_in = 0;
   strm.next_in = Z_NULL;
   
-  int zret = inflateInit2(&strm, MAX_WBITS | 16);
-  //int zret = inflateInit(&strm);
-  if(zret != Z_OK) throw "zlib inflateInit failed.";
+  // +32 lets zlib detect gzip and zlib headers by itself.
+  if(inflateInit2(&strm, MAX_WBITS | 32) != Z_OK) throw "zlib inflateInit failed.";
   
-  do {
-    strm.avail_in = (uInt)input.length();
-    strm.next_in = const_cast<unsigned char *>(in); // Urgh.
+  // Inflate straight into the result, which starts out at a typical ratio for NBT and doubles when full.
+  const unsigned char *in = (const unsigned char *)input.data();
+  size_t consumed = 0, have = 0;
+  std::string out(std::max(input.length() * 4, (size_t)(64 << 10)), 0);
+  
+  for(;;) {
+    // zlib counts in 32 bits, so very large input and output are handed over in pieces.
+    if(strm.avail_in == 0 && consumed < input.length()) {
+      strm.next_in = const_cast<unsigned char *>(in + consumed); // zlib does not write to the input
+      strm.avail_in = (uInt)std::min(input.length() - consumed, (size_t)UINT32_MAX);
+      consumed += strm.avail_in;
+    }
+    
+    if(have == out.length()) out.resize(out.length() * 2);
+    size_t space = std::min(out.length() - have, (size_t)UINT32_MAX);
+    strm.next_out = (unsigned char *)&out[have];
+    strm.avail_out = (uInt)space;
+    
+    int zret = inflate(&strm, Z_NO_FLUSH);
+    have += space - strm.avail_out;
     
-    do {
-      strm.avail_out = CHUNK;
-      strm.next_out = out_buffer;
-      
-      zret = inflate(&strm, Z_NO_FLUSH);
-      if(zret == Z_STREAM_ERROR) throw "zlib inflate stream error.";
-      
-      switch(zret) {
-        case Z_NEED_DICT: zret = Z_DATA_ERROR;
-        case Z_DATA_ERROR:
-        case Z_MEM_ERROR:
-          inflateEnd(&strm);
-          throw "zlib inflate error.";
-      }
-      
-      int have = CHUNK - strm.avail_out;
-      out.append((char *)out_buffer, have);
-    } while(strm.avail_out == 0);
-  } while(zret != Z_STREAM_END);
+    if(zret == Z_STREAM_END) break;
+    if(zret == Z_OK) continue;
+    
+    inflateEnd(&strm);
+    // There is always room for output, so a buffer error means the input ended before the stream did.
+    throw zret == Z_BUF_ERROR ? "Compressed data is truncated." : "zlib inflate error.";
+  }
   inflateEnd(&strm);
   
+  out.resize(have);
   return out;
 }
 
-std::string zlibDeflate(const std::string &input) {
+#pragma mark - Parallel deflate
+
+#define DICT_SIZE (32<<10)
+
+//! Compresses one block of a parallel deflate into raw deflate data that ends on a byte boundary.
+//! Only the last block sets the final-block bit, so the blocks can simply be concatenated.
+static std::string deflateBlock(const unsigned char *data, size_t size, const unsigned char *dict, size_t dictSize, int level, bool last) {
   z_stream strm;
-  const unsigned char *in = (const unsigned char *)input.c_str();
-  
-  std::string out = "";
-  unsigned char out_buffer[CHUNK];
-  
   strm.zalloc = Z_NULL;
   strm.zfree = Z_NULL;
   strm.opaque = Z_NULL;
   
-  int zret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS | 16, 8, Z_DEFAULT_STRATEGY);
-  // deflateInit(&strm, level);
-  if(zret != Z_OK) throw "zlib inflateInit failed.";
+  if(deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    throw "zlib deflateInit failed.";
+  
+  if(dictSize && deflateSetDictionary(&strm, dict, (uInt)dictSize) != Z_OK) {
+    deflateEnd(&strm);
+    throw "zlib deflateSetDictionary failed.";
+  }
+  
+  // Z_SYNC_FLUSH can add a few bytes on top of the bound for Z_FINISH.
+  std::string out(deflateBound(&strm, (uLong)size) + 16, '\0');
+  strm.next_in = const_cast<unsigned char *>(data);
+  strm.avail_in = (uInt)size;
+  strm.next_out = (unsigned char *)&out[0];
+  strm.avail_out = (uInt)out.length();
+  
+  int zret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+  bool complete = last ? zret == Z_STREAM_END : zret == Z_OK && strm.avail_in == 0 && strm.avail_out != 0;
+  
+  out.resize(out.length() - strm.avail_out);
+  deflateEnd(&strm);
+  
+  if(!complete) throw "zlib deflate error.";
+  return out;
+}
+
+static void appendU32(std::string &out, uint32_t value, bool bigEndian) {
+  for(int i = 0; i < 4; ++i) {
+    int shift = bigEndian ? 24 - 8 * i : 8 * i;
+    out += (char)((value >> shift) & 0xff);
+  }
+}
+
+static std::string parallelDeflate(const std::string &input, const DeflateOptions &options) {
+  const unsigned char *in = (const unsigned char *)input.data();
+  size_t blockSize = options.blockSize;
+  size_t blockCount = (input.length() + blockSize - 1) / blockSize;
+  
+  std::vector<std::string> blocks(blockCount);
+  std::vector<uLong> checksums(blockCount);
   
-  int flush;
+  std::unique_ptr<nbt::ThreadPool> ownPool;
+  nbt::ThreadPool *pool = options.pool;
+  if(!pool) {
+    ownPool.reset(new nbt::ThreadPool());
+    pool = ownPool.get();
+  }
   
-  do {
-    strm.avail_in = (uInt)input.length();
-    strm.next_in = const_cast<unsigned char *>(in); // Urgh.
+  pool->run(blockCount, [&](size_t i, unsigned) {
+    size_t offset = i * blockSize;
+    size_t size = std::min(blockSize, input.length() - offset);
+    size_t dictSize = std::min(offset, (size_t)DICT_SIZE);
+    
+    blocks[i] = deflateBlock(in + offset, size, in + offset - dictSize, dictSize, options.level, i == blockCount - 1);
     
-    do {
-      strm.avail_out = CHUNK;
-      strm.next_out = out_buffer;
-      
-      flush = Z_FINISH; // Z_NO_FLUSH;
-      zret = deflate(&strm, flush);
-      if(zret == Z_STREAM_ERROR) throw "zlib inflate stream error.";
-      
-      int have = CHUNK - strm.avail_out;
-      out.append((char *)out_buffer, have);
-    } while(strm.avail_out == 0);
+    if(options.format == Compression::Gzip) checksums[i] = crc32(crc32(0, Z_NULL, 0), in + offset, (uInt)size);
+    if(options.format == Compression::Zlib) checksums[i] = adler32(adler32(0, Z_NULL, 0), in + offset, (uInt)size);
+  });
+  
+  // Stitch the per-block checksums together, the combine functions only need each block's length.
+  uLong check = options.format == Compression::Gzip ? crc32(0, Z_NULL, 0) : adler32(0, Z_NULL, 0);
+  for(size_t i = 0; i < blockCount; ++i) {
+    z_off_t size = (z_off_t)std::min(blockSize, input.length() - i * blockSize);
+    if(options.format == Compression::Gzip) check = crc32_combine(check, checksums[i], size);
+    if(options.format == Compression::Zlib) check = adler32_combine(check, checksums[i], size);
+  }
+  
+  std::string out;
+  if(options.format == Compression::Gzip) {
+    // No file name or modification time, OS is unix (like zlib's own gzip header)
+    static const char header[] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3 };
+    out.append(header, sizeof(header));
+  } else if(options.format == Compression::Zlib) {
+    int level = options.level == Z_DEFAULT_COMPRESSION ? 6 : options.level;
+    int flags = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
     
-    if(strm.avail_in != 0) throw "zlib avail_in was above zero";
-  } while(flush != Z_FINISH);
+    unsigned header = (0x78 << 8) | (flags << 6); // deflate, 32K window
+    header += 31 - header % 31;
+    out += (char)(header >> 8);
+    out += (char)(header & 0xff);
+  }
   
-  if(zret != Z_STREAM_END)
-    throw "zlib did not reach end of stream";
+  for(size_t i = 0; i < blockCount; ++i) out += blocks[i];
+  
+  if(options.format == Compression::Gzip) {
+    appendU32(out, (uint32_t)check, false);
+    appendU32(out, (uint32_t)input.length(), false); // Size modulo 2^32
+  } else if(options.format == Compression::Zlib)
+    appendU32(out, (uint32_t)check, true);
   
-  (void)deflateEnd(&strm);
   return out;
 }
 
-#undef CHUNK
\ No newline at end of file
+#undef DICT_SIZE
+
+#pragma mark - Deflate
+
+static int windowBitsFor(Compression::Enum format) {
+  switch(format) {
+    case Compression::Gzip: return MAX_WBITS | 16;
+    case Compression::Raw: return -MAX_WBITS;
+    default: return MAX_WBITS;
+  }
+}
+
+std::string zlibDeflate(const std::string &input, const DeflateOptions &options) {
+  // Without a block size there is nothing to split, so that is the serial path as well.
+  if(options.parallel && options.blockSize && input.length() > options.blockSize) return parallelDeflate(input, options);
+  
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.avail_in = 0;
+  
+  if(deflateInit2(&strm, options.level, Z_DEFLATED, windowBitsFor(options.format), 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    throw "zlib deflateInit failed.";
+    
+  // Deflate straight into the result, which starts out at zlib's bound (so one call usually does it)
+  // and doubles in case that isn't enough for input handed over in pieces.
+  const unsigned char *in = (const unsigned char *)input.data();
+  size_t consumed = 0, have = 0;
+  std::string out(deflateBound(&strm, (uLong)std::min(input.length(), (size_t)UINT32_MAX)), 0);
+  
+  for(;;) {
+    // zlib counts in 32 bits, so very large input and output are handed over in pieces.
+    if(strm.avail_in == 0 && consumed < input.length()) {
+      strm.next_in = const_cast<unsigned char *>(in + consumed); // zlib does not write to the input
+      strm.avail_in = (uInt)std::min(input.length() - consumed, (size_t)UINT32_MAX);
+      consumed += strm.avail_in;
+    }
+    
+    if(have == out.length()) out.resize(out.length() * 2);
+    size_t space = std::min(out.length() - have, (size_t)UINT32_MAX);
+    strm.next_out = (unsigned char *)&out[have];
+    strm.avail_out = (uInt)space;
+    
+    int zret = deflate(&strm, consumed == input.length() ? Z_FINISH : Z_NO_FLUSH);
+    have += space - strm.avail_out;
+    
+    if(zret == Z_STREAM_END) break;
+    if(zret == Z_OK) continue;
+    
+    deflateEnd(&strm);
+    throw "zlib deflate error.";
+  }
+  deflateEnd(&strm);
+  
+  out.resize(have);
+  return out;
+}
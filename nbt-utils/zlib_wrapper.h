@@ -10,7 +10,50 @@
 #define __nbt_utils__zlib_wrapper__
 
 #include <string>
-std::string zlibInflate(const std::string &);
-std::string zlibDeflate(const std::string &);
+#include <stddef.h>
+#include <stdint.h>
+
+struct Compression {
+#ifdef EMSCRIPTEN
+  // (emscripten)
+  // Using chars instead of an enum-values makes bindings easier.
+  
+  typedef char Enum;
+  enum Values : char {
+#else
+  enum Enum : char {
+#endif
+    None = 0,
+    Gzip = 1,
+    Zlib = 2,
+    Raw  = 3  //!< Bare deflate data without header or checksum, never detected
+  };
+};
+
+namespace nbt { class ThreadPool; }
+
+struct DeflateOptions {
+  int level;                   //!< 0 (store) to 9 (best), -1 for zlib's default
+  Compression::Enum format;
+  
+  //! Splits input larger than blockSize into blocks that are compressed in parallel, like pigz does.
+  //! Every block is primed with the last 32K of its predecessor, so the ratio stays close to a single
+  //! stream, and the output is still one standard gzip/zlib/raw stream.
+  bool parallel;
+  size_t blockSize;            //!< 0 compresses serially
+  
+  //! Pool to compress on, NULL for a temporary one. Inside a task of this pool the blocks are
+  //! compressed one after another on the calling thread (see ThreadPool::run).
+  nbt::ThreadPool *pool;
+  
+  DeflateOptions(Compression::Enum format = Compression::Gzip, int level = -1)
+  : level(level), format(format), parallel(false), blockSize(128 << 10), pool(NULL) {}
+};
+
+//! Tells gzip and zlib streams apart by their magic bytes, everything else is assumed to be uncompressed
+Compression::Enum detectCompression(const uint8_t *data, size_t size);
+
+std::string zlibInflate(const std::string &); //!< Accepts both gzip and zlib streams
+std::string zlibDeflate(const std::string &, const DeflateOptions &options = DeflateOptions());
 
 #endif /* defined(__nbt_utils__zlib_wrapper__) */
\ No newline at end of file
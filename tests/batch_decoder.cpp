@@ -0,0 +1,68 @@
+//
+//  batch_decoder.cpp
+//  tests
+//
+
+#include "test.h"
+#include "batch_decoder.h"
+#include "diff.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  std::vector<std::unique_ptr<Tag>> documents(size_t count) {
+    std::vector<std::unique_ptr<Tag>> all;
+    for(size_t i = 0; i < count; ++i)
+      all.push_back(std::unique_ptr<Tag>(document(("{xPos:" + std::to_string(i) + ",heights:[I;1,2,3]}").c_str())));
+    return all;
+  }
+}
+
+TEST(batch_decode_blobs) {
+  std::vector<std::unique_ptr<Tag>> expected = documents(64);
+  std::vector<std::string> blobs;
+  for(size_t i = 0; i < expected.size(); ++i) {
+    std::string raw = encode(expected[i].get());
+    blobs.push_back(i % 3 == 0 ? raw : zlibDeflate(raw, DeflateOptions(i % 3 == 1 ? Compression::Gzip : Compression::Zlib)));
+  }
+  blobs[5].resize(blobs[5].length() / 2); // Truncated
+  blobs[9] = "\x0a\x00\x00\x0b\x00\x01x\x7f\xff\xff\xff"; // Impossible array length
+  
+  BatchDecoder decoder(4);
+  std::vector<DecodeResult> results = decoder.decode(blobs);
+  EXPECT(results.size() == blobs.size());
+  
+  for(size_t i = 0; i < results.size(); ++i) {
+    if(i == 5 || i == 9) EXPECT(!results[i].tag && results[i].error);
+    else EXPECT(results[i].tag && !results[i].error && equalTags(results[i].tag.get(), expected[i].get()));
+  }
+  
+  // The decoder keeps its buffers between batches
+  EXPECT(decoder.decode(blobs).size() == blobs.size());
+  EXPECT(decoder.decode(std::vector<std::string>()).empty());
+}
+
+TEST(batch_decode_region) {
+  std::vector<std::unique_ptr<Tag>> expected = documents(3);
+  std::vector<std::string> payloads;
+  for(size_t i = 0; i < expected.size(); ++i) payloads.push_back(zlibDeflate(encode(expected[i].get()), DeflateOptions(Compression::Zlib)));
+  payloads.push_back("not a chunk");
+  
+  std::string file = regionFile(payloads, { 2, 2, 2, 2 });
+  RegionFile region((const uint8_t *)file.data(), file.length());
+  
+  // The broken chunk is reported in its result instead of failing the others
+  BatchDecoder decoder(2);
+  std::vector<ChunkPos> positions;
+  std::vector<DecodeResult> results = decoder.decode(region, &positions);
+  EXPECT(results.size() == 4 && positions.size() == 4);
+  
+  for(size_t i = 0; i < results.size() && i < positions.size(); ++i) {
+    EXPECT(positions[i].x == (int)i && positions[i].z == 0);
+    if(i < 3) EXPECT(results[i].tag && !results[i].error && equalTags(results[i].tag.get(), expected[i].get()));
+    else EXPECT(!results[i].tag && results[i].error);
+  }
+}
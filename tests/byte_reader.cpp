@@ -0,0 +1,73 @@
+//
+//  byte_reader.cpp
+//  tests
+//
+
+#include "test.h"
+#include "lazy_tag.h"
+#include "query.h"
+#include "tag_visitor.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  class Counter : public TagVisitor {
+  public:
+    size_t events = 0;
+    virtual bool beginCompound(const NameRef &) { ++events; return true; }
+    virtual bool beginList(const NameRef &, TagType::Enum, uint32_t) { ++events; return true; }
+    virtual void scalar(const NameRef &, const Scalar &) { ++events; }
+  };
+  
+  std::string bytes(const uint8_t *data, size_t size) { return std::string((const char *)data, size); }
+}
+
+TEST(reader_rejects_truncated_input) {
+  std::unique_ptr<Tag> root(document("{a:1b,s:\"text\",l:[I;1,2],c:{x:[1L,2L]},n:[{y:2.5d}]}"));
+  std::string raw = encode(root.get());
+  
+  for(size_t length = 0; length < raw.length(); ++length) {
+    EXPECT_THROWS(decode(raw.substr(0, length)));
+    ByteReader reader((const uint8_t *)raw.data(), length);
+    EXPECT_THROWS(Tag::skip(reader));
+  }
+  
+  std::unique_ptr<Tag> whole(decode(raw));
+  EXPECT(encode(whole.get()) == raw);
+}
+
+TEST(reader_rejects_end_lists_with_entries) {
+  // A list with an empty name and 16M EndTags in 8 bytes, and the same list inside a compound
+  const uint8_t list[] = { 9, 0, 0, 0, 1, 0, 0, 0 };
+  const uint8_t compound[] = { 10, 0, 0, 9, 0, 1, 'l', 0, 1, 0, 0, 0, 0 };
+  
+  ByteReader reader(list, sizeof(list));
+  EXPECT_THROWS(Tag::read(reader));
+  EXPECT_THROWS(decode(bytes(compound, sizeof(compound))));
+  
+  ByteReader skipped(compound, sizeof(compound));
+  EXPECT_THROWS(Tag::skip(skipped));
+  
+  LazyDocument lazyList(list, sizeof(list));
+  EXPECT_THROWS(lazyList.getRoot().getCount());
+  LazyDocument lazyCompound(compound, sizeof(compound));
+  EXPECT_THROWS(lazyCompound.getRoot().get("l"));
+  
+  Counter counter;
+  EXPECT_THROWS(visit(compound, sizeof(compound), counter));
+  
+  std::vector<Query::RawMatch> matches;
+  EXPECT_THROWS(Query("l[*]").scan(compound, sizeof(compound), matches));
+  
+  // Without entries the list is fine, which is how empty lists are usually written
+  const uint8_t empty[] = { 10, 0, 0, 9, 0, 1, 'l', 0, 0, 0, 0, 0, 0 };
+  std::unique_ptr<Tag> read(decode(bytes(empty, sizeof(empty))));
+  EXPECT(read->select("l").size() == 1 && ((ListTag *)read->select("l")[0])->value.empty());
+  
+  Counter emptyCounter;
+  visit(empty, sizeof(empty), emptyCounter);
+  EXPECT(emptyCounter.events == 2);
+}
@@ -0,0 +1,100 @@
+//
+//  content_hash.cpp
+//  tests
+//
+
+#include "test.h"
+#include "diff.h"
+#include "snbt.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  const char *sample =
+    "{version:3,name:\"world\",heights:[I;1,2,3],states:[L;10L,-20L],"
+    "left:{items:[{id:\"a\",n:1b},{id:\"b\",n:2b}]},right:{items:[{id:\"a\",n:1b},{id:\"b\",n:2b}]}}";
+    
+  uint64_t hashOf(Tag *root, const char *path) { return root->select(path)[0]->contentHash(); }
+}
+
+TEST(content_hashes_match_across_reads) {
+  std::unique_ptr<Tag> original(document(sample));
+  std::string raw = encode(original.get());
+  
+  std::unique_ptr<Tag> eager(decode(raw)), lazy(decode(raw, true));
+  EXPECT(eager->contentHash() == original->contentHash());
+  EXPECT(lazy->contentHash() == original->contentHash());
+  
+  // Equal subtrees hash alike wherever they are, which is what deduplication relies on
+  EXPECT(hashOf(eager.get(), "left") == hashOf(eager.get(), "right"));
+  EXPECT(hashOf(eager.get(), "left.items[0]") != hashOf(eager.get(), "left.items[1]"));
+  EXPECT(hashOf(eager.get(), "heights") != hashOf(eager.get(), "states"));
+}
+
+TEST(content_hashes_follow_edits) {
+  std::unique_ptr<Tag> original(document(sample));
+  std::string raw = encode(original.get());
+  
+  std::unique_ptr<Tag> root(decode(raw, true));
+  uint64_t before = root->contentHash(), left = hashOf(root.get(), "left");
+  EXPECT(root->hasContentHash());
+  
+  ((IntArrayTag *)root->select("heights")[0])->value.setElement(0, 100);
+  EXPECT(!root->hasContentHash());
+  EXPECT(root->contentHash() != before);
+  EXPECT(hashOf(root.get(), "left") == left); // Untouched siblings keep their cached hash
+  
+  ((ByteTag *)root->select("right.items[1].n")[0])->setValue(3);
+  EXPECT(hashOf(root.get(), "right") != left);
+  
+  ((ByteTag *)root->select("right.items[1].n")[0])->setValue(2);
+  EXPECT(hashOf(root.get(), "right") == left);
+  
+  std::unique_ptr<Tag> copy(copyTag(root.get()));
+  EXPECT(copy->contentHash() == root->contentHash());
+}
+
+TEST(content_hashes_agree_with_equal_tags) {
+  // Pairs equalTags considers equal: different order, shadowed duplicates, both nested
+  const char *equal[][2] = {
+    { "{x:1,y:2}", "{y:2,x:1}" },
+    { "{x:1,x:2}", "{x:2}" },
+    { "{a:{x:1,x:2,y:[{p:1b,q:2b}]}}", "{a:{y:[{q:2b,p:1b}],x:2}}" }
+  };
+  
+  // Pairs that differ although they have the same keys and values
+  const char *different[][2] = {
+    { "{x:1,y:2}", "{x:2,y:1}" },
+    { "{x:1,x:2}", "{x:1}" },
+    { "{l:[1,2]}", "{l:[2,1]}" },
+    { "{x:1}", "{x:1,y:1}" }
+  };
+  
+  for(size_t i = 0; i < sizeof(equal) / sizeof(*equal); ++i) {
+    std::unique_ptr<Tag> a(parseSNBT(equal[i][0])), b(parseSNBT(equal[i][1]));
+    EXPECT(equalTags(a.get(), b.get()));
+    EXPECT(a->contentHash() == b->contentHash());
+    
+    // Cached hashes must not change the outcome
+    EXPECT(equalTags(a.get(), b.get()));
+    EXPECT(diff(a.get(), b.get()).empty());
+  }
+  
+  for(size_t i = 0; i < sizeof(different) / sizeof(*different); ++i) {
+    std::unique_ptr<Tag> a(parseSNBT(different[i][0])), b(parseSNBT(different[i][1]));
+    EXPECT(a->contentHash() != b->contentHash());
+    EXPECT(!equalTags(a.get(), b.get()));
+  }
+  
+  // The same diff with and without hashes computed beforehand
+  std::unique_ptr<Tag> a(parseSNBT("{k:{x:1,y:2},v:3}")), b(parseSNBT("{k:{y:2,x:1},v:4}"));
+  std::basic_string<unsigned char> cold = diff(a.get(), b.get()).encode();
+  std::unique_ptr<Tag> c(parseSNBT("{k:{x:1,y:2},v:3}")), d(parseSNBT("{k:{y:2,x:1},v:4}"));
+  c->contentHash();
+  d->contentHash();
+  EXPECT(diff(c.get(), d.get()).encode() == cold);
+  EXPECT(diff(c.get(), d.get()).size() == 1);
+}
@@ -0,0 +1,90 @@
+//
+//  diff.cpp
+//  tests
+//
+
+#include "test.h"
+#include "diff.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  const char *before =
+    "{version:1,name:\"world\",spawn:[I;0,64,0],removed:{x:1},"
+    "players:[{id:\"a\",hp:20.0f},{id:\"b\",hp:10.0f},{id:\"c\",hp:5.0f}],log:[\"one\",\"two\",\"three\"]}";
+  
+  const char *after =
+    "{version:2,name:\"world\",spawn:[I;0,70,0],"
+    "players:[{id:\"c\",hp:5.0f},{id:\"a\",hp:18.0f},{id:\"d\",hp:20.0f}],log:[\"one\",\"three\",\"four\"],added:{y:2}}";
+  
+  Patch roundTrip(const Patch &patch) {
+    std::basic_string<unsigned char> data = patch.encode();
+    return Patch::decode(data.data(), data.size());
+  }
+  
+  //! Applies the patch between before and after to a copy of before, directly and after an encode/decode round trip
+  void checkPatch(const DiffOptions &options) {
+    std::unique_ptr<Tag> a(document(before)), b(document(after));
+    Patch patch = diff(a.get(), b.get(), options);
+    EXPECT(!patch.empty());
+    
+    Patch decoded = roundTrip(patch);
+    EXPECT(decoded.size() == patch.size());
+    EXPECT(decoded.encode() == patch.encode());
+    
+    for(size_t i = 0; i < decoded.size(); ++i) {
+      EXPECT(decoded.edits[i].op == patch.edits[i].op);
+      EXPECT(decoded.edits[i].getPath() == patch.edits[i].getPath());
+    }
+    
+    const Patch *patches[] = { &patch, &decoded };
+    for(size_t i = 0; i < 2; ++i) {
+      // On a tree that was read, so unchanged parts are copied from the previous encoding
+      std::unique_ptr<Tag> target(decode(encode(a.get()), true));
+      patches[i]->apply(target.get());
+      
+      EXPECT(equalTags(target.get(), b.get()));
+      EXPECT(encode(target.get()) == encodeFresh(target.get()));
+      EXPECT(diff(target.get(), b.get(), options).empty());
+    }
+  }
+}
+
+TEST(patch_by_index) {
+  checkPatch(DiffOptions());
+}
+
+TEST(patch_by_list_key) {
+  DiffOptions options;
+  options.listKey = "id";
+  checkPatch(options);
+  
+  // Matching by id leaves the entry that only moved alone
+  std::unique_ptr<Tag> a(document(before)), b(document(after));
+  EXPECT(diff(a.get(), b.get(), options).size() < diff(a.get(), b.get()).size());
+}
+
+TEST(patch_of_equal_trees_is_empty) {
+  std::unique_ptr<Tag> a(document(before));
+  std::unique_ptr<Tag> b(decode(encode(a.get())));
+  Patch patch = diff(a.get(), b.get());
+  
+  EXPECT(patch.empty());
+  EXPECT(roundTrip(patch).empty());
+}
+
+TEST(patch_rejects_invalid_input) {
+  std::unique_ptr<Tag> a(document(before)), b(document(after));
+  std::basic_string<unsigned char> data = diff(a.get(), b.get()).encode();
+  
+  EXPECT_THROWS(Patch::decode(data.data(), data.size() - 1));
+  EXPECT_THROWS(Patch::decode(data.data(), 3));
+  
+  // Paths that don't exist in the target
+  std::unique_ptr<Tag> other(document("{version:1}"));
+  Patch patch = Patch::decode(data.data(), data.size());
+  EXPECT_THROWS(patch.apply(other.get()));
+}
@@ -0,0 +1,62 @@
+//
+//  endianness.cpp
+//  tests
+//
+
+#include "test.h"
+#include "endianness.h"
+
+#include <string.h>
+
+namespace {
+  //! The widest kernel moves 64 bytes per step (two AVX2 vectors), lengths up to twice that plus an
+  //! element cover the unrolled loop, the single-vector loop and the scalar tail of every kernel.
+  const size_t maxBytes = 2 * 64;
+  
+  //! Big-endian values to host order one byte at a time
+  void referenceSwap(uint8_t *dst, const uint8_t *src, size_t count, size_t size) {
+    uint16_t probe = 1;
+    bool littleEndian = *(uint8_t *)&probe == 1;
+    
+    for(size_t i = 0; i < count; ++i)
+      for(size_t b = 0; b < size; ++b) dst[i * size + b] = src[i * size + (littleEndian ? size - 1 - b : b)];
+  }
+  
+  bool matchesReference(void (*swapCopy)(void *, const void *, size_t), size_t size) {
+    uint8_t input[maxBytes + 16 + 8], output[maxBytes + 16 + 8], expected[maxBytes + 16 + 8];
+    for(size_t i = 0; i < sizeof(input); ++i) input[i] = (uint8_t)(i * 7 + 1);
+    
+    bool ok = true;
+    for(size_t count = 0; count <= maxBytes / size + 1; ++count) {
+      for(size_t srcOffset = 0; srcOffset < 8; ++srcOffset) {
+        // Out of place, the bytes around the destination have to stay untouched
+        for(size_t dstOffset = 0; dstOffset < 8; ++dstOffset) {
+          memset(output, 0xee, sizeof(output));
+          memset(expected, 0xee, sizeof(expected));
+          referenceSwap(expected + dstOffset, input + srcOffset, count, size);
+          swapCopy(output + dstOffset, input + srcOffset, count);
+          ok = ok && !memcmp(output, expected, sizeof(output));
+        }
+        
+        // In place
+        memcpy(output, input, sizeof(input));
+        memcpy(expected, input, sizeof(input));
+        referenceSwap(expected + srcOffset, input + srcOffset, count, size);
+        swapCopy(output + srcOffset, output + srcOffset, count);
+        ok = ok && !memcmp(output, expected, sizeof(output));
+      }
+    }
+    return ok;
+  }
+}
+
+TEST(swap_copy_matches_scalar_swap) {
+  EXPECT(matchesReference(swapCopy16, 2));
+  EXPECT(matchesReference(swapCopy32, 4));
+  EXPECT(matchesReference(swapCopy64, 8));
+  
+  uint8_t bytes[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  uint64_t value;
+  swapCopy64(&value, bytes, 1);
+  EXPECT(value == 0x0102030405060708ull);
+}
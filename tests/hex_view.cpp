@@ -0,0 +1,82 @@
+//
+//  hex_view.cpp
+//  tests
+//
+
+#include "test.h"
+#include "hex_view.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+// {b:1b} named "root" encodes as 0a 00 04 r o o t 01 00 01 b 01 00 (13 bytes)
+
+TEST(hex_view_rows) {
+  std::unique_ptr<Tag> root(document("{b:1b}"));
+  HexView view;
+  view.update(root.get());
+  
+  EXPECT(view.getSize() == 13);
+  EXPECT(view.getRowCount() == 2);
+  EXPECT(view.rowOf(0) == 0 && view.rowOf(11) == 0 && view.rowOf(12) == 1);
+  
+  std::string rows = view.render(0, 2, 0, 0);
+  EXPECT(rows ==
+    "0x0000: 0a 00 04 72 6f 6f 74 01 00 01 62 01 | ...root...b.\n"
+    "0x000c: 00                                  | .           \n");
+  
+  // Windows are clamped to the rows there are
+  EXPECT(view.render(1, 5, 0, 0) == rows.substr(rows.find('\n') + 1));
+  EXPECT(view.render(2, 1, 0, 0).empty());
+  EXPECT(view.render(7, 1, 0, 0).empty());
+  EXPECT(view.render(0, 0, 0, 0).empty());
+}
+
+TEST(hex_view_selection) {
+  std::unique_ptr<Tag> root(decode(encode(std::unique_ptr<Tag>(document("{b:1b}")).get())));
+  HexView view;
+  view.update(root.get());
+  
+  // The root's name, then the byte tag, which reaches into the second row
+  EXPECT(view.render(0, 1, 3, 7) ==
+    "0x0000: 0a 00 04 <font color=\"red\">72 6f 6f 74 </font>01 00 01 62 01 | ...<font color=\"red\">root</font>...b.\n");
+  
+  Tag *b = root->select("b")[0];
+  EXPECT(b->getStartIndex() == 7 && b->getEndIndex() == 12);
+  EXPECT(view.render(view.rowOf(b->getStartIndex()), 2, b->getStartIndex(), b->getEndIndex()) ==
+    "0x0000: 0a 00 04 72 6f 6f 74 <font color=\"red\">01 00 01 62 01 </font>| ...root<font color=\"red\">...b.</font>\n"
+    "0x000c: 00                                  | .           \n");
+}
+
+TEST(hex_view_offsets_and_escaping) {
+  HexView view(4);
+  const uint8_t bytes[] = { '<', '&', '>', '"', '\'', 0x7f, 0x20, 0x00, 0xff, 'a' };
+  view.setData(bytes, sizeof(bytes));
+  
+  EXPECT(view.getRowCount() == 3);
+  EXPECT(view.render(0, 3, 0, 0) ==
+    "0x0000: 3c 26 3e 22 | &lt;&amp;&gt;&quot;\n"
+    "0x0004: 27 7f 20 00 | &#039;. .\n"
+    "0x0008: ff 61       | .a  \n");
+  
+  // Addresses grow past four digits
+  std::basic_string<unsigned char> large(0x12345, 0);
+  view.setData(large.data(), large.size());
+  EXPECT(view.render(view.rowOf(0x12344), 1, 0, 0) == "0x12344: 00          | .   \n");
+}
+
+TEST(hex_view_follows_edits) {
+  std::unique_ptr<Tag> original(document("{b:1b,s:\"abc\"}"));
+  std::unique_ptr<Tag> root(decode(encode(original.get())));
+  
+  HexView view;
+  view.update(root.get());
+  EXPECT(view.getData() == Tag::serialize(root.get()));
+  
+  ((StringTag *)root->select("s")[0])->setValue("abcdef");
+  view.update(root.get());
+  EXPECT(view.getSize() == encode(root.get()).length());
+  EXPECT(view.getData() == Tag::serialize(root.get()));
+}
@@ -0,0 +1,53 @@
+//
+//  inflate_reader.cpp
+//  tests
+//
+
+#include "test.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  const char *sample = "{name:\"streamed\",ints:[I;1,2,3,4,5,6,7,8],longs:[L;1L,2L],nested:{list:[\"a\",\"b\",\"c\"]}}";
+}
+
+TEST(streamed_reads_match_plain_reads) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::string raw = encode(root.get());
+  
+  // Gzip and zlib input is inflated while parsing, with and without lazy arrays
+  const Compression::Enum formats[] = { Compression::Gzip, Compression::Zlib };
+  for(size_t f = 0; f < 2; ++f) {
+    std::basic_string<unsigned char> saved = Tag::save(root.get(), formats[f]);
+    std::string compressed((const char *)saved.data(), saved.size());
+    
+    std::unique_ptr<Tag> eager(Tag::deserializeCompressed(compressed));
+    EXPECT(encode(eager.get()) == raw);
+    
+    std::unique_ptr<Tag> lazy(Tag::load(compressed, NULL, true));
+    EXPECT(encode(lazy.get()) == raw);
+  }
+}
+
+TEST(streamed_reads_reject_truncated_input) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::basic_string<unsigned char> saved = Tag::save(root.get(), Compression::Gzip);
+  std::string compressed((const char *)saved.data(), saved.size());
+  
+  EXPECT_THROWS(delete Tag::deserializeCompressed(compressed.substr(0, compressed.length() - 12)));
+  EXPECT_THROWS(delete Tag::deserializeCompressed(compressed.substr(0, compressed.length() / 2)));
+}
+
+TEST(documents_with_impossible_lengths) {
+  // An int array claiming two billion entries in a document of a few bytes
+  std::string raw("\x0a\x00\x00\x0b\x00\x01x\x7f\xff\xff\xff", 11);
+  EXPECT_THROWS(delete decode(raw));
+  EXPECT_THROWS(delete decode(raw, true));
+  
+  // The same through the inflating reader, which must not size its window by the claimed length
+  EXPECT_THROWS(delete Tag::deserializeCompressed(zlibDeflate(raw)));
+  EXPECT_THROWS(delete Tag::load(zlibDeflate(raw)));
+}
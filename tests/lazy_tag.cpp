@@ -0,0 +1,107 @@
+//
+//  lazy_tag.cpp
+//  tests
+//
+
+#include "test.h"
+#include "lazy_tag.h"
+#include "diff.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  const char *sample =
+    "{early:{aa:1,deep:[{q:1b},{q:2b}]},middle:[I;1,2,3],"
+    "Level:{Sections:[{Y:0b,Blocks:[L;1L,2L]},{Y:1b,Blocks:[L;3L,4L,5L]}],heights:[7s,8s,9s]},"
+    "late:{x:5,s:\"text\"}}";
+    
+  bool sameTag(LazyTag *lazy, Tag *eager) {
+    std::unique_ptr<Tag> materialized(lazy->materialize());
+    return equalTags(materialized.get(), eager) && materialized->name.str() == eager->name.str();
+  }
+}
+
+TEST(lazy_lookup_indexes_on_demand) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::string raw = encode(root.get());
+  LazyDocument lazy((const uint8_t *)raw.data(), raw.length());
+  
+  LazyTag *late = lazy.getRoot().get("late");
+  EXPECT(late && late->tagType() == TagType::Compound && late->getCount() == 2);
+  EXPECT(late == lazy.getRoot().get("late"));
+  EXPECT(sameTag(late->get("x"), root->select("late.x")[0]));
+  
+  // Finding "late" only scanned over "early", its children are located when they are first asked for.
+  // The document borrows the buffer, so renaming a key in it shows whether that already happened.
+  size_t key = raw.find("aa");
+  raw[key] = raw[key + 1] = 'b';
+  LazyTag *early = lazy.getRoot().get("early");
+  EXPECT(early && !early->get("aa") && early->get("bb"));
+  EXPECT(lazy.getRoot().get("missing") == NULL);
+}
+
+TEST(lazy_nested_access) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::string raw = encode(root.get());
+  LazyDocument lazy(raw);
+  EXPECT(raw.empty()); // Taken over by the document
+  
+  LazyTag &lazyRoot = lazy.getRoot();
+  EXPECT(lazyRoot.getName() == "root" && lazyRoot.getHasName());
+  
+  LazyTag *sections = lazyRoot.find("Level.Sections");
+  EXPECT(sections && sections->getCount() == 2 && sections->getEntryKind() == TagType::Compound);
+  EXPECT(sameTag(sections, root->select("Level.Sections")[0]));
+  
+  // Variable sized entries, then fixed-size ones located arithmetically
+  LazyTag *blocks = lazyRoot.find("Level.Sections.1.Blocks");
+  EXPECT(blocks && blocks->tagType() == TagType::LongArray && blocks->getCount() == 3);
+  EXPECT(sameTag(blocks, root->select("Level.Sections[1].Blocks")[0]));
+  
+  LazyTag *height = lazyRoot.find("Level.heights.2");
+  EXPECT(height && height->tagType() == TagType::Short && !height->getHasName());
+  EXPECT(sameTag(height, root->select("Level.heights[2]")[0]));
+  EXPECT(height->payloadReader().readU16() == 9);
+  EXPECT(height == lazyRoot.find("Level.heights")->getElement(2));
+  
+  EXPECT(sameTag(lazyRoot.find("early.deep.1.q"), root->select("early.deep[1].q")[0]));
+  EXPECT(lazyRoot.find("Level.heights.3") == NULL);
+  EXPECT(lazyRoot.find("Level.Sections.x") == NULL);
+  EXPECT(lazyRoot.find("Level.Missing.Y") == NULL);
+  
+  // A subtree read as a whole is the same as the eagerly read one
+  std::unique_ptr<Tag> all(lazyRoot.materialize());
+  EXPECT(encode(all.get()) == encode(root.get()));
+}
+
+TEST(lazy_rejects_truncated_subtrees) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::string raw = encode(root.get());
+  size_t header = 1 + 2 + 4; // Type, name length and "root"
+  
+  // Wherever the input ends, the scan to "late" runs into it, also on the second try
+  for(size_t length = header; length < raw.length(); ++length) {
+    LazyDocument lazy((const uint8_t *)raw.data(), length);
+    EXPECT_THROWS(lazy.getRoot().get("late"));
+    EXPECT_THROWS(lazy.getRoot().get("late"));
+  }
+  
+  // A size field inside a skipped subtree that runs past the end is caught the same way
+  std::string broken = raw;
+  size_t strings = broken.find("text") - 2;
+  broken[strings + 1] = 100; // The string claims 100 bytes, running past the end
+  LazyDocument lazy((const uint8_t *)broken.data(), broken.length());
+  EXPECT_THROWS(lazy.getRoot().get("late"));
+  EXPECT_THROWS(lazy.getRoot().getCount());
+  
+  // Fixed-size lists at the root are checked before an entry is located
+  std::unique_ptr<Tag> list(document("[1,2,3,4]"));
+  std::string rawList = encode(list.get());
+  LazyDocument truncated((const uint8_t *)rawList.data(), rawList.length() - 1);
+  EXPECT(truncated.getRoot().getCount() == 4);
+  EXPECT_THROWS(truncated.getRoot().getElement(0));
+  EXPECT_THROWS(truncated.getRoot().getElement(3));
+}
@@ -0,0 +1,69 @@
+//
+//  packed_indices.cpp
+//  tests
+//
+
+#include "test.h"
+#include "packed_indices.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  //! Reference packing, one bit at a time
+  std::vector<uint64_t> packSlowly(const std::vector<uint16_t> &indices, unsigned bits, PackedLayout::Enum layout) {
+    std::vector<uint64_t> words(packedLength(indices.size(), bits, layout), 0);
+    size_t perWord = 64 / bits;
+    
+    for(size_t i = 0; i < indices.size(); ++i)
+      for(unsigned b = 0; b < bits; ++b) {
+        size_t bit = layout == PackedLayout::Aligned ? (i / perWord) * 64 + (i % perWord) * bits + b : i * bits + b;
+        if(indices[i] >> b & 1) words[bit / 64] |= (uint64_t)1 << (bit % 64);
+      }
+    return words;
+  }
+}
+
+TEST(packed_indices_round_trip) {
+  const size_t count = 4096 + 7; // Not a multiple of the entries per long
+  const PackedLayout::Enum layouts[] = { PackedLayout::Spanning, PackedLayout::Aligned };
+  
+  for(unsigned bits = 1; bits <= 16; ++bits)
+    for(size_t l = 0; l < 2; ++l) {
+      std::vector<uint16_t> indices(count);
+      for(size_t i = 0; i < count; ++i) indices[i] = (uint16_t)((i * 2654435761u >> 7) & ((1u << bits) - 1));
+      
+      std::vector<uint64_t> words(packedLength(count, bits, layouts[l]));
+      packIndices(indices.data(), count, bits, layouts[l], words.data());
+      EXPECT(words == packSlowly(indices, bits, layouts[l]));
+      
+      std::vector<uint16_t> unpacked(count);
+      unpackIndices(words.data(), words.size(), bits, layouts[l], unpacked.data(), count);
+      if(unpacked != indices) printf("  %u bits, layout %zu\n", bits, l);
+      EXPECT(unpacked == indices);
+      
+      // Through a tag, which is marked dirty and read back from its encoding
+      std::unique_ptr<Tag> root(document("{data:[L;]}"));
+      std::string raw = encode(root.get());
+      std::unique_ptr<Tag> read(decode(raw, true));
+      LongArrayTag *tag = (LongArrayTag *)read->select("data")[0];
+      
+      packIndices(tag, indices.data(), count, bits, layouts[l]);
+      std::unique_ptr<Tag> reread(decode(encode(read.get()), true));
+      EXPECT(unpackIndices(((LongArrayTag *)reread->select("data")[0])->value, count, bits, layouts[l]) == indices);
+    }
+}
+
+TEST(packed_lengths) {
+  EXPECT(packedLength(4096, 4, PackedLayout::Aligned) == 256);
+  EXPECT(packedLength(4096, 5, PackedLayout::Aligned) == 342); // 12 per long
+  EXPECT(packedLength(4096, 5, PackedLayout::Spanning) == 320);
+  EXPECT(packedLength(0, 5, PackedLayout::Spanning) == 0);
+  
+  EXPECT(bitsForPalette(1) == 4);
+  EXPECT(bitsForPalette(17) == 5);
+  EXPECT(bitsForPalette(2, 1) == 1);
+  EXPECT(bitsForPalette(3, 1) == 2);
+}
@@ -0,0 +1,78 @@
+//
+//  query.cpp
+//  tests
+//
+
+#include "test.h"
+#include "query.h"
+#include "diff.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  const char *level =
+    "{Level:{xPos:3,zPos:-2,Entities:["
+    "{id:\"minecraft:zombie\",Pos:[1.0d,64.0d,2.0d],Health:20.0f},"
+    "{id:\"minecraft:cow\",Pos:[5.0d,70.0d,-1.0d],Health:10.0f},"
+    "{id:\"minecraft:zombie\",Pos:[3.0d,65.0d,9.0d],Health:8.0f,Items:[{Count:64b},{Count:1b}]}"
+    "],\"key with spaces\":{\"a.b\":7}}}";
+  
+  const char *paths[] = {
+    "Level.xPos",
+    "Level.Entities[*].Pos[1]",
+    "Level.Entities[-1].id",
+    "Level.Entities[{id:\"minecraft:zombie\"}].Health",
+    "Level.Entities[].Items[{Count:64b}]",
+    "Level.*.a.b",
+    "Level.\"key with spaces\".\"a.b\"",
+    "Level.Entities[5]",
+    "Missing"
+  };
+}
+
+TEST(query_select) {
+  std::unique_ptr<Tag> root(document(level));
+  
+  EXPECT(Query("Level.Entities[*].Pos[1]").count(root.get()) == 3);
+  EXPECT(Query("Level.Entities[{id:\"minecraft:zombie\"}]").count(root.get()) == 2);
+  EXPECT(Query("Level.Entities[{id:\"minecraft:zombie\"}].Items[{Count:64b}]").count(root.get()) == 1);
+  EXPECT(Query("Level.Entities[5]").first(root.get()) == NULL);
+  
+  Tag *x = Query("Level.xPos").first(root.get());
+  EXPECT(x && x->tagType() == TagType::Int && ((IntTag *)x)->value == 3);
+  
+  Tag *last = Query("Level.Entities[-1].Health").first(root.get());
+  EXPECT(last && ((FloatTag *)last)->value == 8.0f);
+  
+  EXPECT_THROWS(Query("Level.Entities[").count(root.get()));
+}
+
+TEST(query_scan_matches_select) {
+  std::unique_ptr<Tag> root(document(level));
+  std::string raw = encode(root.get());
+  const uint8_t *data = (const uint8_t *)raw.data();
+  
+  std::unique_ptr<Tag> read(decode(raw));
+  for(size_t i = 0; i < sizeof(paths) / sizeof(*paths); ++i) {
+    Query query(paths[i]);
+    std::vector<Tag *> selected = query.select(read.get());
+    
+    std::vector<Query::RawMatch> matches;
+    EXPECT(query.scan(data, raw.length(), matches) == selected.size());
+    if(matches.size() != selected.size()) {
+      printf("  %s: %zu scanned, %zu selected\n", paths[i], matches.size(), selected.size());
+      continue;
+    }
+    
+    for(size_t j = 0; j < matches.size(); ++j) {
+      std::unique_ptr<Tag> materialized(Query::materialize(data, matches[j]));
+      EXPECT(matches[j].type == selected[j]->tagType());
+      EXPECT(matches[j].startIndex == selected[j]->getStartIndex());
+      EXPECT(matches[j].endIndex == selected[j]->getEndIndex());
+      EXPECT(equalTags(materialized.get(), selected[j]));
+    }
+  }
+}
@@ -0,0 +1,59 @@
+//
+//  region_file.cpp
+//  tests
+//
+
+#include "test.h"
+#include "region_file.h"
+#include "diff.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+TEST(region_chunks) {
+  std::vector<std::unique_ptr<Tag>> chunks;
+  std::vector<std::string> payloads;
+  for(int x = 0; x < 3; ++x) {
+    chunks.push_back(std::unique_ptr<Tag>(document(("{xPos:" + std::to_string(x) + ",heights:[I;1,2,3]}").c_str())));
+    std::string raw = encode(chunks.back().get());
+    payloads.push_back(x == 0 ? zlibDeflate(raw, DeflateOptions(Compression::Zlib)) : x == 1 ? zlibDeflate(raw) : raw);
+  }
+  payloads.push_back("not a chunk");
+  
+  std::string file = regionFile(payloads, { 2, 1, 3, 2 });
+  RegionFile region((const uint8_t *)file.data(), file.length());
+  
+  for(int x = 0; x < 3; ++x) {
+    EXPECT(region.hasChunk(x, 0));
+    std::unique_ptr<Tag> chunk(region.readChunk(x, 0));
+    EXPECT(chunk && equalTags(chunk.get(), chunks[x].get()));
+  }
+  
+  const uint8_t *data;
+  size_t size;
+  Compression::Enum compression;
+  EXPECT(region.getChunkData(2, 0, data, size, compression) && compression == Compression::None && size == payloads[2].length());
+  
+  EXPECT(!region.hasChunk(0, 1));
+  EXPECT(region.readChunk(5, 5) == NULL);
+  EXPECT_THROWS(delete region.readChunk(3, 0));
+  
+  size_t present = 0;
+  for(auto it = region.begin(); it != region.end(); ++it) ++present;
+  EXPECT(present == 4);
+}
+
+TEST(region_headers) {
+  RegionFile empty(NULL, 0); // Files the game created but never wrote to
+  EXPECT(!empty.hasChunk(0, 0));
+  
+  std::string file = regionFile({ "x" }, { 2 });
+  EXPECT_THROWS(RegionFile((const uint8_t *)file.data(), 100));
+  
+  // An entry pointing past the end of the file
+  file.resize(2 * RegionFile::SectorSize);
+  RegionFile cut((const uint8_t *)file.data(), file.length());
+  EXPECT_THROWS(delete cut.readChunk(0, 0));
+}
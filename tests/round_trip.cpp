@@ -0,0 +1,133 @@
+//
+//  round_trip.cpp
+//  tests
+//
+
+#include "test.h"
+#include "diff.h"
+
+#include <functional>
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+// serialize() copies the bytes of clean subtrees from the previous encoding, so every edit has to
+// mark the edited tag and its ancestors dirty, or the stale bytes end up in the output.
+
+namespace {
+  const char *sample =
+    "{count:3,name:\"chunk\",heights:[I;1,2,3,4],states:[L;10L,-20L,30L],light:[B;1b,2b,3b],"
+    "sections:[{Y:0b,data:[L;1L,2L]},{Y:1b,data:[L;3L,4L]}],"
+    "nested:{deeper:{ints:[I;5,6,7],bytes:[B;-1b,0b]}},tags:[\"a\",\"b\"]}";
+  
+  template<typename T> T *at(Tag *root, const char *path) {
+    std::vector<Tag *> tags = root->select(path);
+    if(tags.size() != 1 || tags[0]->tagType() != T().tagType()) throw "Path doesn't lead to exactly one tag of the expected type.";
+    return (T *)tags[0];
+  }
+  
+  struct Edit {
+    const char *name;
+    std::function<void (Tag *)> apply;
+  };
+  
+  std::vector<Edit> edits() {
+    std::vector<Edit> all;
+    all.push_back({ "primitive", [](Tag *root) { at<IntTag>(root, "count")->setValue(4); }});
+    all.push_back({ "string length", [](Tag *root) { at<StringTag>(root, "name")->setValue("a longer name"); }});
+    all.push_back({ "int array element", [](Tag *root) { at<IntArrayTag>(root, "heights")->value.setElement(0, 100); }});
+    all.push_back({ "long array resize", [](Tag *root) {
+      I64Array &states = at<LongArrayTag>(root, "states")->value;
+      states.resize(5);
+      for(size_t i = 0; i < 5; ++i) states.setElement(i, (int64_t)i << 40);
+    }});
+    all.push_back({ "byte array text", [](Tag *root) { at<ByteArrayTag>(root, "light")->value.deserialize("0a 0b 0c 0d"); }});
+    all.push_back({ "int array text", [](Tag *root) { at<IntArrayTag>(root, "heights")->value.deserialize("7 8 9"); }});
+    all.push_back({ "array in list", [](Tag *root) { at<LongArrayTag>(root, "sections[1].data")->value.setElement(1, -1); }});
+    all.push_back({ "nested array", [](Tag *root) { at<IntArrayTag>(root, "nested.deeper.ints")->value.setElement(2, 70000); }});
+    all.push_back({ "array through view", [](Tag *root) {
+      I32Array &ints = at<IntArrayTag>(root, "nested.deeper.ints")->value;
+      ints.ownData()[0] = -5;
+      ints.markDirty();
+    }});
+    all.push_back({ "array assignment", [](Tag *root) {
+      at<ByteArrayTag>(root, "nested.deeper.bytes")->setValue(at<ByteArrayTag>(root, "light")->value);
+      at<ByteArrayTag>(root, "nested.deeper.bytes")->value.setElement(0, 42); // Must not change light
+    }});
+    all.push_back({ "compound add", [](Tag *root) { at<CompoundTag>(root, "nested")->value.jsSet("added", new DoubleTag(0.5)); }});
+    all.push_back({ "compound remove", [](Tag *root) { at<CompoundTag>(root, "nested.deeper")->value.jsRemove("bytes"); }});
+    all.push_back({ "list add", [](Tag *root) { ((StringTag *)at<ListTag>(root, "tags")->addElement())->setValue("c"); }});
+    all.push_back({ "list remove", [](Tag *root) { at<ListTag>(root, "sections")->removeElement(0); }});
+    all.push_back({ "rename", [](Tag *root) { at<CompoundTag>(root, "nested")->value.jsRename("deeper", "deepest"); }});
+    return all;
+  }
+  
+  //! Applies each edit to a freshly read document and compares the output with an encoding from scratch
+  void checkEdits(bool lazyArrays) {
+    std::unique_ptr<Tag> original(document(sample));
+    std::string raw = encode(original.get());
+    
+    std::vector<Edit> all = edits();
+    for(auto it = all.begin(); it != all.end(); ++it) {
+      std::unique_ptr<Tag> root(decode(raw, lazyArrays));
+      EXPECT(encode(root.get()) == raw);
+      
+      it->apply(root.get());
+      std::string edited = encode(root.get());
+      if(edited != encodeFresh(root.get())) printf("  after edit \"%s\"\n", it->name);
+      EXPECT(edited == encodeFresh(root.get()));
+      EXPECT(edited != raw);
+      
+      // A second encoding reuses the first one
+      EXPECT(encode(root.get()) == edited);
+    }
+    
+    // All edits on the same tree, each followed by a serialize() that the next one has to invalidate
+    std::unique_ptr<Tag> root(decode(raw, lazyArrays));
+    for(auto it = all.begin(); it != all.end(); ++it) {
+      it->apply(root.get());
+      if(encode(root.get()) != encodeFresh(root.get())) printf("  after edit \"%s\" in sequence\n", it->name);
+      EXPECT(encode(root.get()) == encodeFresh(root.get()));
+    }
+  }
+}
+
+TEST(unchanged_documents_round_trip) {
+  std::unique_ptr<Tag> original(document(sample));
+  std::string raw = encode(original.get());
+  
+  std::unique_ptr<Tag> eager(decode(raw)), lazy(decode(raw, true));
+  EXPECT(encode(eager.get()) == raw);
+  EXPECT(encode(lazy.get()) == raw);
+  EXPECT(encodeFresh(lazy.get()) == raw);
+  EXPECT(equalTags(eager.get(), lazy.get()));
+  
+  EXPECT(Tag::save(eager.get(), Compression::Gzip) == Tag::save(lazy.get(), Compression::Gzip));
+  
+  DataFormat format;
+  std::basic_string<unsigned char> saved = Tag::save(eager.get(), Compression::Zlib);
+  std::unique_ptr<Tag> loaded(Tag::load(std::string((const char *)saved.data(), saved.size()), &format, true));
+  EXPECT(format.compression == Compression::Zlib && format.withName);
+  EXPECT(encode(loaded.get()) == raw);
+}
+
+TEST(edits_reencode_eager) {
+  checkEdits(false);
+}
+
+TEST(edits_reencode_lazy) {
+  checkEdits(true);
+}
+
+TEST(copies_keep_their_arrays) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::string raw = encode(root.get());
+  
+  std::unique_ptr<Tag> copy(copyTag(root.get()));
+  at<IntArrayTag>(copy.get(), "heights")->value.setElement(3, -4);
+  
+  EXPECT(at<IntArrayTag>(root.get(), "heights")->value.getElement(3) == 4);
+  EXPECT(encode(root.get()) == raw);
+  EXPECT(encode(copy.get()) != raw);
+}
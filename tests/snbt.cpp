@@ -0,0 +1,119 @@
+//
+//  snbt.cpp
+//  tests
+//
+
+#include "test.h"
+#include "snbt.h"
+#include "diff.h"
+#include "query.h"
+
+#include <memory>
+#include <locale.h>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  //! Texts in the form toSNBT writes them, so printing what was parsed gives the same text back
+  const char *canonical[] = {
+    "{}",
+    "[]",
+    "{a:1b,b:-2s,c:3,d:4L,e:1.5f,f:0.1d}",
+    "{min:-2147483648,max:2147483647,big:9223372036854775807L,small:-9223372036854775808L}",
+    "{s:\"x\\\"y'\",empty:\"\",\"key with spaces\":\"caf\xc3\xa9\"}",
+    "{b:[B;1b,-1b],i:[I;1,2,-3],l:[L;-1L,4294967296L],none:[I;]}",
+    "{lists:[[1,2],[3]],compounds:[{},{a:[\"x\",\"y\"]}],doubles:[0.25d,-10000000000.0d]}",
+    "[{id:\"minecraft:stone\",Count:64b,tag:{Damage:0,display:{Name:'{\"text\":\"Rock\"}'}}}]"
+  };
+}
+
+TEST(snbt_prints_what_it_parsed) {
+  for(size_t i = 0; i < sizeof(canonical) / sizeof(*canonical); ++i) {
+    std::unique_ptr<Tag> tag(parseSNBT(canonical[i]));
+    std::string printed = toSNBT(tag.get());
+    if(printed != canonical[i]) printf("  %s printed as %s\n", canonical[i], printed.c_str());
+    EXPECT(printed == canonical[i]);
+  }
+}
+
+TEST(snbt_round_trips_binary) {
+  for(size_t i = 0; i < sizeof(canonical) / sizeof(*canonical); ++i) {
+    std::unique_ptr<Tag> tag(document(canonical[i]));
+    std::string raw = encode(tag.get());
+    
+    for(int style = SNBTStyle::Compact; style <= SNBTStyle::Pretty; ++style) {
+      std::unique_ptr<Tag> parsed(parseSNBT(toSNBT(tag.get(), (SNBTStyle::Enum)style)));
+      parsed->name = "root";
+      parsed->hasName = true;
+      
+      EXPECT(encode(parsed.get()) == raw);
+      EXPECT(equalTags(parsed.get(), tag.get()));
+    }
+  }
+}
+
+TEST(snbt_names_compound_entries) {
+  std::unique_ptr<Tag> parsed(document("{pos:{x:1,\"key with spaces\":2b},list:[{inner:3s}]}"));
+  std::unique_ptr<Tag> read(decode(encode(parsed.get())));
+  
+  const char *paths[] = { "pos", "pos.x", "pos.\"key with spaces\"", "list", "list[0].inner" };
+  for(size_t i = 0; i < sizeof(paths) / sizeof(*paths); ++i) {
+    Tag *a = parsed->select(paths[i])[0], *b = read->select(paths[i])[0];
+    EXPECT(a->name.str() == b->name.str() && a->hasName == b->hasName);
+    
+    // A subtree is written with its own name
+    EXPECT(encode(a) == encode(b));
+  }
+  
+  // List entries stay unnamed, like those read from binary
+  EXPECT(!parsed->select("list[0]")[0]->hasName && parsed->select("list[0]")[0]->name.str().empty());
+}
+
+TEST(snbt_accepts_the_game_syntax) {
+  std::unique_ptr<Tag> loose(parseSNBT(" { 'single' : 'quoted' , bare : word, flag: true, n: 5S, l: [ 1L ,2l ] , } "));
+  std::unique_ptr<Tag> strict(parseSNBT("{single:\"quoted\",bare:\"word\",flag:1b,n:5s,l:[1L,2L]}"));
+  EXPECT(equalTags(loose.get(), strict.get()));
+}
+
+TEST(snbt_reals_ignore_the_locale) {
+  // A comma-decimal LC_NUMERIC must neither change what is written nor what is accepted.
+  // Without one of these installed this only checks the "C" locale.
+  const char *commaLocales[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR" };
+  const char *locale = NULL;
+  for(size_t i = 0; i < sizeof(commaLocales) / sizeof(*commaLocales) && !locale; ++i)
+    locale = setlocale(LC_NUMERIC, commaLocales[i]);
+  if(!locale) printf("  no comma-decimal locale installed, checking \"C\" only\n");
+  
+  const char *text = "{a:1.5f,b:0.1d,c:-2.5e-10d,d:[0.25f,3.0f]}";
+  std::unique_ptr<Tag> tag(parseSNBT(text));
+  EXPECT(toSNBT(tag.get()) == text);
+  EXPECT(((FloatTag *)tag->select("a")[0])->value == 1.5f);
+  EXPECT(((DoubleTag *)tag->select("b")[0])->value == 0.1);
+  
+  // Nothing but '.' is a decimal point
+  double value;
+  const char *number = "1,5";
+  EXPECT(parseReal(number, number + 3, value) == number + 1 && value == 1);
+  number = "2.75e1x";
+  EXPECT(parseReal(number, number + 7, value) == number + 6 && value == 27.5);
+  
+  // Query filters read their numbers the same way
+  std::unique_ptr<Tag> list(parseSNBT("{l:[{v:1.5d},{v:2.5d}]}"));
+  EXPECT(Query("l[{v:2.5d}]").count(list.get()) == 1);
+  
+  setlocale(LC_NUMERIC, "C");
+}
+
+TEST(snbt_rejects_unterminated_strings) {
+  // The string tag parsed so far has to be freed on the way out (run under -fsanitize=address to see leaks)
+  const char *unterminated[] = { "\"open", "'open", "{a:\"open", "[\"a\",'b", "{a:{b:\"open\\\"}}" };
+  for(size_t i = 0; i < sizeof(unterminated) / sizeof(*unterminated); ++i)
+    EXPECT_THROWS(delete parseSNBT(unterminated[i]));
+}
+
+TEST(snbt_rejects_invalid_text) {
+  const char *invalid[] = { "", "{", "{a:}", "{a:1,,}", "[1,2b]", "[I;1b]", "{a:1}}", "[B;300b]" };
+  for(size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); ++i)
+    EXPECT_THROWS(delete parseSNBT(invalid[i]));
+}
@@ -0,0 +1,127 @@
+//
+//  tag_visitor.cpp
+//  tests
+//
+
+#include "test.h"
+#include "tag_visitor.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  //! Writes every event as a line, names are only read at the end of each call's work
+  class Trace : public TagVisitor {
+  public:
+    std::string out;
+    const char *skip = NULL; //!< Compounds and lists with this name are skipped
+    
+    virtual bool beginCompound(const NameRef &name) {
+      if(skip && name == skip) return event("skip compound", name);
+      return event("compound", name);
+    }
+    virtual void endCompound() { out += "end compound\n"; }
+    
+    virtual bool beginList(const NameRef &name, TagType::Enum entryKind, uint32_t count) {
+      if(skip && name == skip) return event("skip list", name);
+      return event("list " + std::to_string(entryKind) + "x" + std::to_string(count), name);
+    }
+    virtual void endList() { out += "end list\n"; }
+    
+    virtual void scalar(const NameRef &name, const Scalar &value) {
+      bool integer = value.type <= TagType::Long;
+      event(std::to_string(value.type) + "=" + (integer ? std::to_string(value.integer) : std::to_string(value.real)), name);
+    }
+    
+    virtual void string(const NameRef &name, const char *data, size_t length) {
+      event("string " + std::string(data, length), name);
+    }
+    
+    virtual void array(const NameRef &name, TagType::Enum type, const uint8_t *data, uint32_t count) {
+      std::string bytes;
+      for(uint32_t i = 0, size = count * (uint32_t)Tag::fixedPayloadSize(type == TagType::ByteArray ? TagType::Byte : type == TagType::IntArray ? TagType::Int : TagType::Long); i < size; ++i)
+        bytes += std::to_string(data[i]) + " ";
+      event("array " + std::to_string(type) + "x" + std::to_string(count) + ": " + bytes, name);
+    }
+    
+  private:
+    bool event(const std::string &what, const NameRef &name) {
+      out += what + " '" + name.str() + "'\n";
+      return !(skip && name == skip);
+    }
+  };
+  
+  //! Long keys, so a small inflate window has to move between reading a key and its value
+  const char *sample =
+    "{a_fairly_long_key_name:1b,another_long_key_for_a_short:-2s,"
+    "nested_compound_with_a_long_name:{innermost_integer_value:3,and_a_long_after_it:4L,"
+    "floats:[1.5f,2.5f],deeper:{the_string_value_here:\"hello there\",empty:\"\"}},"
+    "bytes_of_the_array_follow:[B;1b,2b,3b],ints:[I;7,-1],longs:[L;9L],"
+    "list_of_compounds:[{first_entry_name:1},{second_entry_name:2.0d}],nothing:[],last_key_in_the_root:5b}";
+  
+  std::string trace(const std::string &raw, bool compressed, size_t window, const char *skip = NULL) {
+    Trace visitor;
+    visitor.skip = skip;
+    
+    if(compressed) {
+      std::string deflated = zlibDeflate(raw);
+      InflateReader reader((const uint8_t *)deflated.data(), deflated.length(), window);
+      visit(reader, visitor);
+    } else
+      visit((const uint8_t *)raw.data(), raw.length(), visitor);
+    return visitor.out;
+  }
+}
+
+TEST(visitor_events) {
+  std::unique_ptr<Tag> root(document("{n:1b,s:\"x\",l:[I;1],c:{list:[\"a\"]}}"));
+  std::string raw = encode(root.get());
+  
+  EXPECT(trace(raw, false, 0) ==
+    "compound 'root'\n"
+    "1=1 'n'\n"
+    "string x 's'\n"
+    "array 11x1: 0 0 0 1  'l'\n"
+    "compound 'c'\n"
+    "list 8x1 'list'\n"
+    "string a ''\n"
+    "end list\n"
+    "end compound\n"
+    "end compound\n");
+  
+  // Skipped subtrees emit neither their entries nor their end event
+  EXPECT(trace(raw, false, 0, "c") ==
+    "compound 'root'\n"
+    "1=1 'n'\n"
+    "string x 's'\n"
+    "array 11x1: 0 0 0 1  'l'\n"
+    "skip compound 'c'\n"
+    "end compound\n");
+}
+
+TEST(visitor_over_compressed_input) {
+  std::unique_ptr<Tag> root(document(sample));
+  std::string raw = encode(root.get());
+  std::string plain = trace(raw, false, 0);
+  EXPECT(plain.find("3=3 'innermost_integer_value'") != std::string::npos);
+  
+  // Windows smaller than most keys, so every key is read before the window moves on
+  const size_t windows[] = { 1, 7, 16, 64, 64 << 10 };
+  for(size_t i = 0; i < sizeof(windows) / sizeof(*windows); ++i) {
+    std::string streamed = trace(raw, true, windows[i]);
+    if(streamed != plain) printf("  window of %zu bytes:\n%s", windows[i], streamed.c_str());
+    EXPECT(streamed == plain);
+    
+    EXPECT(trace(raw, true, windows[i], "nested_compound_with_a_long_name") == trace(raw, false, 0, "nested_compound_with_a_long_name"));
+    EXPECT(trace(raw, true, windows[i], "list_of_compounds") == trace(raw, false, 0, "list_of_compounds"));
+  }
+  
+  // Truncated input throws from the visitor as it does from Tag::read
+  std::string deflated = zlibDeflate(raw.substr(0, raw.length() - 5));
+  Trace visitor;
+  InflateReader reader((const uint8_t *)deflated.data(), deflated.length(), 16);
+  EXPECT_THROWS(visit(reader, visitor));
+  EXPECT_THROWS(visit((const uint8_t *)raw.data(), raw.length() - 5, visitor));
+}
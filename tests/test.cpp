@@ -0,0 +1,124 @@
+//
+//  test.cpp
+//  tests
+//
+
+#include "test.h"
+#include "snbt.h"
+#include "region_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <vector>
+
+using namespace nbt;
+
+// Usage: tests [name]
+//
+// Runs every case (or those whose name contains the argument) and exits with 1 if any of them failed.
+
+#pragma mark - Registry
+
+namespace {
+  struct Case {
+    const char *name;
+    tests::Function run;
+  };
+  
+  //! Function-local, so registrations from other translation units can't run before it exists
+  std::vector<Case> &cases() {
+    static std::vector<Case> all;
+    return all;
+  }
+  
+  size_t failures = 0;
+}
+
+tests::Registration::Registration(const char *name, Function run) {
+  Case c = { name, run };
+  cases().push_back(c);
+}
+
+void tests::fail(const char *file, int line, const char *expression) {
+  printf("  %s:%d: expected %s\n", file, line, expression);
+  ++failures;
+}
+
+#pragma mark - Helpers
+
+Tag *tests::document(const char *snbt) {
+  Tag *root = parseSNBT(snbt);
+  root->name = "root";
+  root->hasName = true;
+  return root;
+}
+
+std::string tests::encode(Tag *tag) {
+  std::basic_string<unsigned char> data = Tag::serialize(tag);
+  return std::string((const char *)data.data(), data.size());
+}
+
+std::string tests::encodeFresh(const Tag *tag) {
+  std::unique_ptr<Tag> copy(copyTag(tag));
+  return encode(copy.get());
+}
+
+Tag *tests::decode(const std::string &data, bool lazyArrays) {
+  ByteReader reader((const uint8_t *)data.data(), data.length());
+  reader.lazyArrays = lazyArrays;
+  return Tag::read(reader);
+}
+
+static void appendU32(std::string &out, uint32_t value) {
+  for(int shift = 24; shift >= 0; shift -= 8) out += (char)(value >> shift);
+}
+
+std::string tests::regionFile(const std::vector<std::string> &payloads, const std::vector<uint8_t> &types) {
+  const size_t sectorSize = RegionFile::SectorSize;
+  std::string header(2 * sectorSize, 0), body;
+  
+  for(size_t i = 0; i < payloads.size(); ++i) {
+    size_t sector = 2 + body.length() / sectorSize;
+    appendU32(body, (uint32_t)payloads[i].length() + 1); // Includes the compression byte
+    body += (char)types[i];
+    body += payloads[i];
+    body.resize((body.length() + sectorSize - 1) / sectorSize * sectorSize, 0);
+    
+    // Offset in sectors and the number of sectors
+    std::string entry;
+    appendU32(entry, (uint32_t)(sector << 8 | (2 + body.length() / sectorSize - sector)));
+    header.replace(4 * i, 4, entry);
+  }
+  return header + body;
+}
+
+#pragma mark - Running
+
+int main(int argc, const char *argv[]) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+  size_t run = 0, failed = 0;
+  
+  for(auto it = cases().begin(); it != cases().end(); ++it) {
+    if(filter && !strstr(it->name, filter)) continue;
+    
+    printf("%s\n", it->name);
+    size_t before = failures;
+    try {
+      it->run();
+    } catch(const char *error) {
+      printf("  threw: %s\n", error);
+      ++failures;
+    } catch(const std::exception &e) {
+      printf("  threw: %s\n", e.what());
+      ++failures;
+    }
+    
+    ++run;
+    if(failures != before) ++failed;
+  }
+  
+  printf("\n%zu of %zu cases passed\n", run - failed, run);
+  return failed ? 1 : 0;
+}
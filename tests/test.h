@@ -0,0 +1,58 @@
+//
+//  test.h
+//  tests
+//
+
+#ifndef __tests__test__
+#define __tests__test__
+
+#include <string>
+#include <vector>
+
+#include "nbt_utils.h"
+
+// A minimal harness: TEST(name) { ... } defines a case that registers itself, EXPECT records a
+// failure and carries on. Errors thrown by the library (const char *) fail the case they escape from.
+
+namespace tests {
+  typedef void (*Function)();
+  
+  struct Registration {
+    Registration(const char *name, Function run);
+  };
+  
+  void fail(const char *file, int line, const char *expression);
+  
+  //! Named document from SNBT, the root is called "root"
+  nbt::Tag *document(const char *snbt);
+  
+  //! Tag::serialize as a std::string, which is easier to compare and print
+  std::string encode(nbt::Tag *tag);
+  
+  //! Encoding of a deep copy of tag, i.e. one without any encoding or positions to reuse
+  std::string encodeFresh(const nbt::Tag *tag);
+  
+  //! Reads an uncompressed named document, optionally keeping array payloads in wire order
+  nbt::Tag *decode(const std::string &data, bool lazyArrays = false);
+  
+  //! Region file with one chunk per payload at x = 0, 1, ... (z = 0). Each payload is stored as is
+  //! behind the given compression type (1 gzip, 2 zlib, 3 uncompressed) and padded to whole sectors.
+  std::string regionFile(const std::vector<std::string> &payloads, const std::vector<uint8_t> &types);
+}
+
+#define TEST(name) \
+  static void test_##name(); \
+  static tests::Registration registration_##name(#name, test_##name); \
+  static void test_##name()
+  
+#define EXPECT(condition) \
+  do { if(!(condition)) tests::fail(__FILE__, __LINE__, #condition); } while(0)
+  
+#define EXPECT_THROWS(statement) \
+  do { \
+    bool thrown = false; \
+    try { statement; } catch(const char *) { thrown = true; } \
+    if(!thrown) tests::fail(__FILE__, __LINE__, "throws: " #statement); \
+  } while(0)
+  
+#endif /* defined(__tests__test__) */
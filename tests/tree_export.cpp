@@ -0,0 +1,187 @@
+//
+//  tree_export.cpp
+//  tests
+//
+
+#include "test.h"
+#include "tree_export.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  //! One node of an export, decoded the way the editor reads the buffer
+  struct Node {
+    TagType::Enum type;
+    uint8_t flags;
+    uint32_t parent, count, startIndex, endIndex;
+    std::string name, key;
+    int64_t integer;
+    std::string string;
+  };
+  
+  class ExportReader {
+  public:
+    explicit ExportReader(const std::string &buffer) : p((const uint8_t *)buffer.data()), end(p + buffer.length()) {}
+    
+    std::vector<Node> nodes() {
+      std::vector<Node> all(u32());
+      for(size_t i = 0; i < all.size(); ++i) {
+        Node &node = all[i];
+        node.type = (TagType::Enum)u8();
+        node.flags = u8();
+        node.parent = u32();
+        node.count = u32();
+        node.startIndex = u32();
+        node.endIndex = u32();
+        node.name = string();
+        if(node.flags & TreeExport::HasKey) node.key = string();
+        
+        node.integer = 0;
+        switch(node.type) {
+          case TagType::Byte: node.integer = (int8_t)u8(); break;
+          case TagType::Short: node.integer = (int16_t)(u8() << 8 | u8()); break;
+          case TagType::Int: node.integer = (int32_t)u32(); break;
+          case TagType::Long: node.integer = (int64_t)((uint64_t)u32() << 32 | u32()); break;
+          case TagType::Float: u32(); break;
+          case TagType::Double: u32(); u32(); break;
+          case TagType::String: node.string = string(); break;
+          case TagType::List: node.integer = u8(); break;
+          default: break;
+        }
+      }
+      if(p != end) throw "Export has trailing bytes.";
+      return all;
+    }
+    
+  private:
+    uint8_t u8() {
+      if(p == end) throw "Export ends early.";
+      return *p++;
+    }
+    
+    uint32_t u32() {
+      uint32_t v = 0;
+      for(int i = 0; i < 4; ++i) v = v << 8 | u8();
+      return v;
+    }
+    
+    std::string string() {
+      size_t length = u8() << 8;
+      length |= u8();
+      if((size_t)(end - p) < length) throw "Export ends early.";
+      
+      std::string s((const char *)p, length);
+      p += length;
+      return s;
+    }
+    
+    const uint8_t *p, *end;
+  };
+  
+  //! Document with a list and a compound of count entries each
+  Tag *containers(size_t count) {
+    std::string snbt = "{list:[";
+    for(size_t i = 0; i < count; ++i) snbt += (i ? "," : "") + std::to_string(i);
+    snbt += "],compound:{";
+    for(size_t i = 0; i < count; ++i) snbt += (i ? ",k" : "k") + std::to_string(i) + ":" + std::to_string(i) + "s";
+    snbt += "}}";
+    
+    std::unique_ptr<Tag> tree(document(snbt.c_str()));
+    return decode(encode(tree.get()));
+  }
+}
+
+TEST(tree_export_layout) {
+  std::unique_ptr<Tag> original(document("{id:7b,pos:[L;1L,2L,3L],name:\"x\",list:[{a:1},{}],big:-5000000000L}"));
+  std::unique_ptr<Tag> root(decode(encode(original.get())));
+  
+  TreeExport tree(root.get());
+  std::vector<Node> nodes = ExportReader(tree.getBuffer()).nodes();
+  EXPECT(nodes.size() == tree.getNodeCount() && nodes.size() == 9);
+  
+  // Pre-order, so children follow their parent and list entries their siblings
+  const TagType::Enum types[] = {
+    TagType::Compound, TagType::Byte, TagType::LongArray, TagType::String,
+    TagType::List, TagType::Compound, TagType::Int, TagType::Compound, TagType::Long
+  };
+  const uint32_t parents[] = { 0xffffffff, 0, 0, 0, 0, 4, 5, 4, 0 };
+  
+  for(size_t i = 0; i < nodes.size() && i < 9; ++i) {
+    EXPECT(nodes[i].type == types[i]);
+    EXPECT(nodes[i].parent == parents[i]);
+    EXPECT(tree.getTag(i)->tagType() == types[i]);
+    EXPECT(nodes[i].startIndex == tree.getTag(i)->getStartIndex());
+    EXPECT(nodes[i].endIndex == tree.getTag(i)->getEndIndex());
+    EXPECT(!(nodes[i].flags & TreeExport::ChildrenOmitted));
+  }
+  
+  if(nodes.size() == 9) {
+    EXPECT(nodes[0].name == "root" && (nodes[0].flags & TreeExport::HasName));
+    EXPECT(nodes[0].count == 5 && nodes[2].count == 3 && nodes[4].count == 2 && nodes[7].count == 0);
+    EXPECT(nodes[1].name == "id" && nodes[1].integer == 7);
+    EXPECT(nodes[3].string == "x");
+    EXPECT(nodes[4].integer == TagType::Compound);
+    EXPECT(nodes[5].name.empty() && !(nodes[5].flags & TreeExport::HasName));
+    EXPECT(nodes[6].integer == 1);
+    EXPECT(nodes[8].integer == -5000000000ll);
+    EXPECT(nodes[0].startIndex == 0 && nodes[0].endIndex == encode(root.get()).length());
+  }
+  
+  // Only the top levels
+  std::vector<Node> top = ExportReader(TreeExport(root.get(), 1).getBuffer()).nodes();
+  EXPECT(top.size() == 6);
+  EXPECT(top.size() == 6 && (top[4].flags & TreeExport::ChildrenOmitted) && top[4].count == 2);
+}
+
+TEST(tree_export_pages) {
+  std::unique_ptr<Tag> root(containers(10));
+  const char *paths[] = { "list", "compound" };
+  
+  // The first page comes with the tree, the containers say there is more
+  std::vector<Node> nodes = ExportReader(TreeExport(root.get(), -1, 4).getBuffer()).nodes();
+  EXPECT(nodes.size() == 11); // Root, then each container with its first four entries
+  if(nodes.size() == 11) {
+    EXPECT(nodes[1].count == 10 && (nodes[1].flags & TreeExport::ChildrenOmitted));
+    EXPECT(nodes[5].integer == 3 && nodes[5].parent == 1);
+    EXPECT(nodes[6].count == 10 && (nodes[6].flags & TreeExport::ChildrenOmitted));
+    EXPECT(nodes[10].key.empty() && nodes[10].name == "k3");
+  }
+  
+  // A page size that covers every entry omits nothing
+  std::vector<Node> whole = ExportReader(TreeExport(root.get(), -1, 10).getBuffer()).nodes();
+  EXPECT(whole.size() == 23 && !(whole[1].flags & TreeExport::ChildrenOmitted));
+  
+  for(size_t c = 0; c < 2; ++c) {
+    Tag *container = root->select(paths[c])[0];
+    
+    std::vector<Node> first = ExportReader(TreeExport(container, 0, 4, -1, 0).getBuffer()).nodes();
+    EXPECT(first.size() == 4);
+    EXPECT(first.size() == 4 && first[0].integer == 0 && first[3].integer == 3 && first[0].parent == 0xffffffff);
+    
+    std::vector<Node> middle = ExportReader(TreeExport(container, 4, 4, -1, 0).getBuffer()).nodes();
+    EXPECT(middle.size() == 4 && middle[0].integer == 4);
+    
+    // The last page is clamped to the entries there are
+    TreeExport last(container, 8, 4, -1, 0);
+    std::vector<Node> lastNodes = ExportReader(last.getBuffer()).nodes();
+    EXPECT(lastNodes.size() == 2 && last.getNodeCount() == 2);
+    EXPECT(lastNodes.size() == 2 && lastNodes[0].integer == 8 && lastNodes[1].integer == 9);
+    EXPECT(last.getNodeCount() == 2 && last.getTag(1) == (c ? ((CompoundTag *)container)->value.find(std::string("k9"))->second.get() : ((ListTag *)container)->getElement(9)));
+    
+    // Offsets at and past the end give empty pages
+    EXPECT(ExportReader(TreeExport(container, 10, 4, -1, 0).getBuffer()).nodes().empty());
+    EXPECT(ExportReader(TreeExport(container, 25, 4, -1, 0).getBuffer()).nodes().empty());
+    EXPECT(ExportReader(TreeExport(container, 9, (size_t)-1, -1, 0).getBuffer()).nodes().size() == 1);
+  }
+  
+  // Entries of a page are paged themselves
+  std::unique_ptr<Tag> nested(document("{outer:[[1,2,3],[4,5,6]]}"));
+  std::vector<Node> page = ExportReader(TreeExport(nested->select("outer")[0], 0, 2, -1, 2).getBuffer()).nodes();
+  EXPECT(page.size() == 6 && (page[0].flags & TreeExport::ChildrenOmitted) && page[0].count == 3);
+  
+  // Scalars have no entries to page
+  EXPECT(ExportReader(TreeExport(root->select("list[0]")[0], 0, 4, -1, 0).getBuffer()).nodes().empty());
+}
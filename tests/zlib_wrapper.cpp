@@ -0,0 +1,129 @@
+//
+//  zlib_wrapper.cpp
+//  tests
+//
+
+#include "test.h"
+#include "thread_pool.h"
+
+#include <memory>
+
+using namespace nbt;
+using namespace tests;
+
+namespace {
+  //! Somewhat compressible bytes, so parallel blocks reference data of their predecessors
+  std::string text(size_t size) {
+    std::string out(size, 0);
+    uint32_t state = 1;
+    for(size_t i = 0; i < size; ++i) {
+      state = state * 1103515245 + 12345;
+      out[i] = "nbt-utils region chunk "[(state >> 16) % 23];
+    }
+    return out;
+  }
+}
+
+TEST(inflate_rejects_truncated_input) {
+  std::string input = text(100000);
+  std::string compressed = zlibDeflate(input);
+  EXPECT(zlibInflate(compressed) == input);
+  EXPECT(zlibInflate(zlibDeflate("")) == "");
+  
+  EXPECT_THROWS(zlibInflate(compressed.substr(0, compressed.length() / 2)));
+  EXPECT_THROWS(zlibInflate(compressed.substr(0, 10)));
+  
+  std::string corrupt = compressed;
+  corrupt[12] ^= 0x55;
+  corrupt[13] ^= 0x55;
+  EXPECT_THROWS(zlibInflate(corrupt));
+}
+
+TEST(load_detects_the_format) {
+  const Compression::Enum formats[] = { Compression::Gzip, Compression::Zlib, Compression::None };
+  
+  for(int named = 0; named < 2; ++named) {
+    std::unique_ptr<Tag> root(document("{name:\"detected\",values:[I;1,2,3]}"));
+    root->hasName = named != 0;
+    std::string raw = encode(root.get());
+    
+    for(size_t f = 0; f < 3; ++f) {
+      std::string input = formats[f] == Compression::None ? raw : zlibDeflate(raw, DeflateOptions(formats[f]));
+      EXPECT(detectCompression((const uint8_t *)input.data(), input.length()) == formats[f]);
+      
+      DataFormat format;
+      std::unique_ptr<Tag> loaded(Tag::load(input, &format));
+      EXPECT(format.compression == formats[f]);
+      EXPECT(format.withName == (named != 0));
+      EXPECT(encode(loaded.get()) == raw);
+      
+      // Saving the same way reproduces the input
+      if(formats[f] != Compression::None) {
+        std::basic_string<unsigned char> saved = Tag::save(loaded.get(), format.compression);
+        std::unique_ptr<Tag> reloaded(Tag::load(std::string((const char *)saved.data(), saved.size())));
+        EXPECT(encode(reloaded.get()) == raw);
+      }
+    }
+  }
+}
+
+TEST(parallel_deflate_round_trip) {
+  const Compression::Enum formats[] = { Compression::Gzip, Compression::Zlib, Compression::Raw };
+  std::string input = text(1 << 20);
+  
+  for(size_t f = 0; f < 3; ++f) {
+    std::string serial = zlibDeflate(input, DeflateOptions(formats[f]));
+    
+    DeflateOptions parallel(formats[f]);
+    parallel.parallel = true;
+    parallel.blockSize = 64 << 10;
+    std::string blocks = zlibDeflate(input, parallel);
+    EXPECT(blocks.length() < serial.length() + serial.length() / 20); // Close to a single stream
+    
+    // zlibInflate detects gzip and zlib, raw deflate is checked through its framed siblings
+    if(formats[f] != Compression::Raw) {
+      EXPECT(detectCompression((const uint8_t *)blocks.data(), blocks.length()) == formats[f]);
+      EXPECT(zlibInflate(blocks) == input);
+    }
+  }
+  
+  // Input of exactly one block and just over one block
+  DeflateOptions parallel;
+  parallel.parallel = true;
+  parallel.blockSize = 4096;
+  EXPECT(zlibInflate(zlibDeflate(text(4096), parallel)) == text(4096));
+  EXPECT(zlibInflate(zlibDeflate(text(4097), parallel)) == text(4097));
+  
+  // Levels from store to best
+  for(int level = 0; level <= 9; level += 3) {
+    parallel.level = level;
+    EXPECT(zlibInflate(zlibDeflate(input, parallel)) == input);
+  }
+}
+
+TEST(parallel_deflate_edge_cases) {
+  std::string input = text(300 << 10);
+  
+  // Without a block size there's nothing to split, the result is the serial stream
+  DeflateOptions unsplit;
+  unsplit.parallel = true;
+  unsplit.blockSize = 0;
+  EXPECT(zlibDeflate(input, unsplit) == zlibDeflate(input));
+  
+  // Serial output larger than the compression buffer used to be, and empty input
+  std::string stored = zlibDeflate(input, DeflateOptions(Compression::Zlib, 0));
+  EXPECT(stored.length() > input.length() && zlibInflate(stored) == input);
+  EXPECT(zlibInflate(zlibDeflate("")).empty());
+  
+  // Compressing on a pool from inside one of its own tasks runs the blocks on that thread
+  ThreadPool pool(4);
+  std::vector<std::string> results(8);
+  DeflateOptions nested(Compression::Gzip);
+  nested.parallel = true;
+  nested.blockSize = 32 << 10;
+  nested.pool = &pool;
+  pool.run(results.size(), [&](size_t i, unsigned) { results[i] = zlibDeflate(input, nested); });
+  
+  for(size_t i = 0; i < results.size(); ++i) EXPECT(zlibInflate(results[i]) == input);
+  EXPECT(zlibDeflate(input, nested) == results[0]);
+}